@@ -8,41 +8,430 @@
  *===--------------------------------------------------------------------------------------------===
 */
 #include "capture_impl.h"
+#include <acfutils/time.h>
 #include <XPLMGraphics.h>
 
-#define CACHE_SIZE (1 << 10)
-
 panel_cap_t *panel_cap_new(vect2_t size) {
+    panel_cap_conf_t conf = {.size = size};
+    return panel_cap_new2(&conf);
+}
+
+panel_cap_t *panel_cap_new2(const panel_cap_conf_t *conf) {
+    ASSERT(conf);
     panel_cap_t *cap = safe_calloc(1, sizeof(*cap));
     
     fdr_find(&cap->fbo_dr, "sim/graphics/view/current_gl_fbo");
     list_create(&cap->windows, sizeof(cap_window_t), offsetof(cap_window_t, list));
     
-    cap->size = size;
-    cap->tex = 0;
-    cap->fbo = 0;
+    cap->size = conf->size;
+    cap->format = conf->format;
+    cap->internal_format = 0;
+    cap->num_sources = 1;
+    cap->num_buffers = MAX(1, MIN(conf->num_buffers, CAP_MAX_BUFFERS));
+    cap->evicted = true;
+    cap->next_seq = 1;
+    cap->ready = -1;
+    cap->sig_seq = 1;
+    cap->last_shown = 0;
+    cap->evict_after = 0;
     
     return cap;
 }
 
+// Signature targets are RG32UI, which only integer samplers can read, hence nearest filtering.
+static void sig_target_create(GLuint *tex, GLuint *fbo, GLsizei width, GLsizei height) {
+    glGenTextures(1, tex);
+    glBindTexture(GL_TEXTURE_2D, *tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32UI, width, height, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    gls_invalidate();
+    
+    glGenFramebuffers(1, fbo);
+    gls_bind_framebuffer(GL_DRAW_FRAMEBUFFER, *fbo);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, *tex, 0);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+}
+
+static void sig_target_delete(GLuint *tex, GLuint *fbo) {
+    if(*fbo) glDeleteFramebuffers(1, fbo);
+    if(*tex) glDeleteTextures(1, tex);
+    *fbo = 0;
+    *tex = 0;
+}
+
+static void panel_cap_evict(panel_cap_t *cap) {
+    if(cap->evicted) return;
+    cap->evicted = true;
+    
+    if(cap->shader) glDeleteProgram(cap->shader);
+    cap->shader = 0;
+    
+    for(unsigned i = 0; i < CAP_MAX_BUFFERS; ++i) {
+        if(cap->fence[i]) glDeleteSync(cap->fence[i]);
+        if(cap->tex[i]) glDeleteTextures(1, &cap->tex[i]);
+        glDeleteFramebuffers(CAP_MAX_SOURCES, cap->fbo[i]);
+        cap->fence[i] = 0;
+        cap->tex[i] = 0;
+        memset(cap->fbo[i], 0, sizeof(cap->fbo[i]));
+        cap->seq[i] = 0;
+    }
+    cap->ready = -1;
+    cap->internal_format = 0;
+    
+    for(unsigned i = 0; i < CAP_SIG_READBACKS; ++i) {
+        if(cap->readback[i].fence) glDeleteSync(cap->readback[i].fence);
+        if(cap->readback[i].pbo) glDeleteBuffers(1, &cap->readback[i].pbo);
+        cap->readback[i].fence = 0;
+        cap->readback[i].pbo = 0;
+    }
+    sig_target_delete(&cap->sig_part_tex, &cap->sig_part_fbo);
+    sig_target_delete(&cap->sig_tex, &cap->sig_fbo);
+    if(cap->sig_part_shader) glDeleteProgram(cap->sig_part_shader);
+    if(cap->sig_shader) glDeleteProgram(cap->sig_shader);
+    cap->sig_part_shader = 0;
+    cap->sig_shader = 0;
+    cap->sig_windows = 0;
+    for(cap_window_t *w = list_head(&cap->windows); w; w = list_next(&cap->windows, w)) {
+        w->has_sig = false;
+    }
+}
+
+void panel_cap_set_buffers(panel_cap_t *cap, unsigned count) {
+    ASSERT(cap);
+    count = MAX(1, MIN(count, CAP_MAX_BUFFERS));
+    if(count == cap->num_buffers) return;
+    
+    panel_cap_evict(cap);
+    cap->num_buffers = count;
+}
+
+unsigned panel_cap_add_source(panel_cap_t *cap, GLuint fbo) {
+    ASSERT(cap);
+    VERIFY3U(cap->num_sources, <, CAP_MAX_SOURCES);
+    
+    // The texture arrays are sized for the old layer count, start again.
+    panel_cap_evict(cap);
+    cap->sources[cap->num_sources] = fbo;
+    return cap->num_sources++;
+}
+
+// Picks a texture format for the sim's framebuffer, which must be bound for reading. Blits between
+// matching formats are plain copies; anything else goes through a conversion.
+static GLenum cap_match_format(GLuint src) {
+    // The default framebuffer's attachments can't be queried the same way, assume the usual.
+    if(src == 0) return GL_RGBA8;
+    
+    GLint type = GL_NONE;
+    glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                          GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type);
+    if(type == GL_NONE) return GL_RGBA8;
+    
+    GLint red = 0, alpha = 0, component = GL_UNSIGNED_NORMALIZED;
+    glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                          GL_FRAMEBUFFER_ATTACHMENT_RED_SIZE, &red);
+    glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                          GL_FRAMEBUFFER_ATTACHMENT_ALPHA_SIZE, &alpha);
+    glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                          GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE, &component);
+    
+    if(component == GL_FLOAT) {
+        if(red == 11) return GL_R11F_G11F_B10F;
+        return red > 16 ? GL_RGBA32F : GL_RGBA16F;
+    }
+    if(red == 10) return GL_RGB10_A2;
+    if(red == 16) return GL_RGBA16;
+    return alpha ? GL_RGBA8 : GL_RGB8;
+}
+
+static GLenum cap_internal_format(const panel_cap_t *cap, GLuint src) {
+    switch(cap->format) {
+    case PANEL_CAP_FORMAT_RGBA8: return GL_RGBA8;
+    case PANEL_CAP_FORMAT_RGB565: return GL_RGB565;
+    case PANEL_CAP_FORMAT_RGB10_A2: return GL_RGB10_A2;
+    case PANEL_CAP_FORMAT_AUTO: break;
+    }
+    return cap_match_format(src);
+}
+
+// Drivers generally pad 24-bit textures to 32 bits per pixel.
+static size_t cap_format_bytes(GLenum format) {
+    switch(format) {
+    case GL_RGB565: return 2;
+    case GL_RGBA16:
+    case GL_RGBA16F: return 8;
+    case GL_RGBA32F: return 16;
+    default: return 4;
+    }
+}
+
+// Bytes in the final signature target, or its readback, for `windows` window blocks.
+static size_t sig_size(unsigned windows) {
+    return (size_t)CAP_SIG_TILES * CAP_SIG_TILES * windows * 2 * sizeof(uint32_t);
+}
+
+// Compares a completed readback with the signatures we had, and stamps the tiles that differ.
+static void sig_collect(panel_cap_t *cap, cap_readback_t *rb) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbo);
+    const uint32_t *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sig_size(rb->windows), GL_MAP_READ_BIT);
+    if(data) {
+        cap->sig_seq += 1;
+        for(cap_window_t *w = list_head(&cap->windows); w; w = list_next(&cap->windows, w)) {
+            if(w->index >= rb->windows) continue;
+            
+            for(unsigned y = 0; y < CAP_SIG_TILES; ++y) {
+                const uint32_t *row = data + ((w->index * CAP_SIG_TILES + y) * CAP_SIG_TILES) * 2;
+                for(unsigned x = 0; x < CAP_SIG_TILES; ++x) {
+                    unsigned tile = y * CAP_SIG_TILES + x;
+                    if(w->has_sig && !memcmp(w->sig[tile], row + x * 2, sizeof(w->sig[0]))) continue;
+                    memcpy(w->sig[tile], row + x * 2, sizeof(w->sig[0]));
+                    w->changed[tile] = cap->sig_seq;
+                }
+            }
+            w->has_sig = true;
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+static void sig_poll(panel_cap_t *cap) {
+    // Readbacks complete in the order they were issued, oldest first.
+    for(unsigned i = 0; i < CAP_SIG_READBACKS; ++i) {
+        cap_readback_t *rb = &cap->readback[(cap->next_readback + i) % CAP_SIG_READBACKS];
+        if(!rb->fence) continue;
+        
+        GLenum status = glClientWaitSync(rb->fence, 0, 0);
+        if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+        glDeleteSync(rb->fence);
+        rb->fence = 0;
+        sig_collect(cap, rb);
+    }
+}
+
+// Draws a quad over `rows` rows of a signature target, starting at `bottom`.
+static void sig_draw_rows(GLuint prog, double width, double bottom, double rows) {
+    const vect2_t p[4] = {
+        VECT2(0, bottom),
+        VECT2(0, bottom + rows),
+        VECT2(width, bottom + rows),
+        VECT2(width, bottom)
+    };
+    const vect2_t t[4] = {VECT2(0, 0), VECT2(0, 1), VECT2(1, 1), VECT2(1, 0)};
+    glutils_draw_quads(quad_get(p, t), prog);
+}
+
+// Draws the signatures of every window's region in buffer `buf`, and starts reading them back.
+static void sig_update(panel_cap_t *cap, int buf) {
+    cap_readback_t *rb = &cap->readback[cap->next_readback];
+    if(rb->fence || !cap->num_windows) return;  // The GPU is behind, try again next update
+    
+    const int part_size = CAP_SIG_TILES * CAP_SIG_SPLIT;
+    
+    if(cap->sig_tex && cap->sig_windows != cap->num_windows) {
+        sig_target_delete(&cap->sig_part_tex, &cap->sig_part_fbo);
+        sig_target_delete(&cap->sig_tex, &cap->sig_fbo);
+    }
+    if(!cap->sig_tex) {
+        cap->sig_windows = cap->num_windows;
+        sig_target_create(&cap->sig_part_tex, &cap->sig_part_fbo, part_size, part_size * cap->sig_windows);
+        sig_target_create(&cap->sig_tex, &cap->sig_fbo, CAP_SIG_TILES, CAP_SIG_TILES * cap->sig_windows);
+    }
+    if(!cap->sig_shader) {
+        cap->sig_part_shader = shader_prog_from_text("panel_sig_part_shader",
+            sig_vert_shader, sig_part_frag_shader,
+            "vtx_pos", VTX_ATTRIB_POS, NULL);
+        cap->sig_shader = shader_prog_from_text("panel_sig_shader",
+            sig_vert_shader, sig_frag_shader,
+            "vtx_pos", VTX_ATTRIB_POS, NULL);
+        ASSERT(cap->sig_part_shader != 0);
+        ASSERT(cap->sig_shader != 0);
+    }
+    
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    XPLMSetGraphicsState(0, 1, 0, 0, 0, 0, 0);
+    
+    // Hash each tile's parts, one block per window.
+    mat4 pvm;
+    glm_ortho(0, part_size, 0, part_size * cap->sig_windows, -1, 1, pvm);
+    gls_bind_framebuffer(GL_DRAW_FRAMEBUFFER, cap->sig_part_fbo);
+    glViewport(0, 0, part_size, part_size * cap->sig_windows);
+    gls_use_program(cap->sig_part_shader);
+    gls_bind_texture_array(cap->tex[buf], 0);
+    glUniform1i(glGetUniformLocation(cap->sig_part_shader, "tex"), 0);
+    glUniformMatrix4fv(glGetUniformLocation(cap->sig_part_shader, "pvm"), 1, GL_FALSE, (const GLfloat *)pvm);
+    
+    for(cap_window_t *w = list_head(&cap->windows); w; w = list_next(&cap->windows, w)) {
+        int left = MAX(0, MIN(round(w->pos.x), cap->size.x));
+        int bottom = MAX(0, MIN(round(w->pos.y), cap->size.y));
+        int right = MAX(left, MIN(round(w->pos.x + w->size.x), cap->size.x));
+        int top = MAX(bottom, MIN(round(w->pos.y + w->size.y), cap->size.y));
+        
+        glUniform1i(glGetUniformLocation(cap->sig_part_shader, "layer"), w->layer);
+        glUniform4i(glGetUniformLocation(cap->sig_part_shader, "region"), left, bottom, right - left, top - bottom);
+        glUniform1i(glGetUniformLocation(cap->sig_part_shader, "base"), w->index * part_size);
+        sig_draw_rows(cap->sig_part_shader, part_size, w->index * part_size, part_size);
+    }
+    
+    // Then hash the parts of each tile together, for all windows at once.
+    glm_ortho(0, CAP_SIG_TILES, 0, CAP_SIG_TILES * cap->sig_windows, -1, 1, pvm);
+    gls_bind_framebuffer(GL_DRAW_FRAMEBUFFER, cap->sig_fbo);
+    glViewport(0, 0, CAP_SIG_TILES, CAP_SIG_TILES * cap->sig_windows);
+    gls_use_program(cap->sig_shader);
+    gls_bind_texture(cap->sig_part_tex, 0);
+    glUniform1i(glGetUniformLocation(cap->sig_shader, "parts"), 0);
+    glUniformMatrix4fv(glGetUniformLocation(cap->sig_shader, "pvm"), 1, GL_FALSE, (const GLfloat *)pvm);
+    sig_draw_rows(cap->sig_shader, CAP_SIG_TILES, 0, CAP_SIG_TILES * cap->sig_windows);
+    
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    
+    if(!rb->pbo || rb->windows != cap->sig_windows) {
+        if(!rb->pbo) glGenBuffers(1, &rb->pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, sig_size(cap->sig_windows), NULL, GL_STREAM_READ);
+        rb->windows = cap->sig_windows;
+    } else {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbo);
+    }
+    gls_bind_framebuffer(GL_READ_FRAMEBUFFER, cap->sig_fbo);
+    gls_read_buffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, CAP_SIG_TILES, CAP_SIG_TILES * rb->windows, GL_RG_INTEGER, GL_UNSIGNED_INT, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    
+    rb->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    cap->next_readback = (cap->next_readback + 1) % CAP_SIG_READBACKS;
+}
+
+// Counts as a change to every tile, for every consumer.
+static void sig_reset(panel_cap_t *cap, cap_window_t *w) {
+    w->has_sig = false;
+    for(unsigned i = 0; i < CAP_SIG_TILES * CAP_SIG_TILES; ++i) {
+        w->changed[i] = cap->sig_seq;
+    }
+}
+
+void panel_cap_set_change_detect(panel_cap_t *cap, bool enabled) {
+    ASSERT(cap);
+    if(cap->detect == enabled) return;
+    cap->detect = enabled;
+    
+    cap->sig_seq += 1;
+    for(cap_window_t *w = list_head(&cap->windows); w; w = list_next(&cap->windows, w)) {
+        sig_reset(cap, w);
+    }
+}
+
+bool panel_cap_window_changed(const panel_cap_t *cap, const window_t *window, uint64_t *seen, uint64_t *mask) {
+    ASSERT(cap);
+    ASSERT(window);
+    ASSERT(seen);
+    
+    uint64_t changed = 0;
+    for(const cap_window_t *w = list_head(&cap->windows); w; w = list_next(&cap->windows, w)) {
+        if(w->window != window) continue;
+        for(unsigned i = 0; i < CAP_SIG_TILES * CAP_SIG_TILES; ++i) {
+            if(w->changed[i] > *seen) changed |= 1ull << i;
+        }
+        break;
+    }
+    *seen = cap->sig_seq;
+    if(mask) *mask = changed;
+    return changed != 0;
+}
+
+// Retires the fences of blits that have completed, and picks the newest completed buffer. Only
+// called once per update, so every window of the panel draws from the same buffer until the next.
+static void panel_cap_poll(panel_cap_t *cap) {
+    sig_poll(cap);
+    
+    for(unsigned i = 0; i < cap->num_buffers; ++i) {
+        if(!cap->fence[i]) continue;
+        GLenum status = glClientWaitSync(cap->fence[i], 0, 0);
+        if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) continue;
+        glDeleteSync(cap->fence[i]);
+        cap->fence[i] = 0;
+    }
+    
+    for(unsigned i = 0; i < cap->num_buffers; ++i) {
+        if(!cap->seq[i] || cap->fence[i]) continue;
+        if(cap->ready < 0 || cap->seq[i] > cap->seq[cap->ready]) cap->ready = i;
+    }
+}
+
 void panel_cap_destroy(panel_cap_t *cap) {
     ASSERT(cap);
     
+    panel_cap_evict(cap);
     for(cap_window_t *w = list_head(&cap->windows); w;) {
         cap_window_t *next = list_next(&cap->windows, w);
         window_destroy(w->window);
-        if(w->shader) glDeleteProgram(w->shader);
-        if(w->cache) glutils_cache_destroy(w->cache);
         
         lacf_free(w);
         w = next;
     }
     
-    if(cap->tex) glDeleteTextures(1, &cap->tex);
-    if(cap->fbo) glDeleteFramebuffers(1, &cap->fbo);
     lacf_free(cap);
 }
 
+void panel_cap_set_idle_evict(panel_cap_t *cap, double seconds) {
+    ASSERT(cap);
+    cap->evict_after = seconds > 0 ? seconds * 1e6 : 0;
+}
+
+static void cap_window_get_gl_mem(const cap_window_t *w, window_gl_mem_t *mem) {
+    window_get_gl_mem(w->window, mem);
+}
+
+void panel_cap_get_gl_mem(const panel_cap_t *cap, window_gl_mem_t *mem) {
+    ASSERT(cap);
+    ASSERT(mem);
+    
+    memset(mem, 0, sizeof(*mem));
+    for(const cap_window_t *w = list_head(&cap->windows); w; w = list_next(&cap->windows, w)) {
+        window_gl_mem_t win_mem;
+        cap_window_get_gl_mem(w, &win_mem);
+        window_gl_mem_add(mem, &win_mem);
+    }
+    
+    size_t texel = cap_format_bytes(cap->internal_format);
+    for(unsigned i = 0; i < CAP_MAX_BUFFERS; ++i) {
+        if(cap->tex[i]) {
+            mem->textures += 1;
+            mem->texture_bytes += (size_t)cap->size.x * (size_t)cap->size.y * texel * cap->num_sources;
+        }
+        for(unsigned j = 0; j < CAP_MAX_SOURCES; ++j) {
+            if(cap->fbo[i][j]) mem->framebuffers += 1;
+        }
+    }
+    if(cap->shader) mem->programs += 1;
+    
+    // Change detection readback buffers are counted with the textures.
+    if(cap->sig_tex) {
+        mem->textures += 2;
+        mem->texture_bytes += sig_size(cap->sig_windows) * (1 + CAP_SIG_SPLIT * CAP_SIG_SPLIT);
+    }
+    if(cap->sig_fbo) mem->framebuffers += 2;
+    if(cap->sig_shader) mem->programs += 2;
+    for(unsigned i = 0; i < CAP_SIG_READBACKS; ++i) {
+        if(cap->readback[i].pbo) mem->texture_bytes += sig_size(cap->readback[i].windows);
+    }
+}
+
+void panel_cap_get_window_gl_mem(const panel_cap_t *cap, const window_t *window, window_gl_mem_t *mem) {
+    ASSERT(cap);
+    ASSERT(window);
+    ASSERT(mem);
+    
+    memset(mem, 0, sizeof(*mem));
+    for(const cap_window_t *w = list_head(&cap->windows); w; w = list_next(&cap->windows, w)) {
+        if(w->window != window) continue;
+        cap_window_get_gl_mem(w, mem);
+        return;
+    }
+}
+
 static void draw_cap_window(window_t *window, vect2_t pos, vect2_t size, void *userdata) {
     cap_window_t *win = userdata;
     panel_cap_t *cap = win->cap;
@@ -51,20 +440,17 @@ static void draw_cap_window(window_t *window, vect2_t pos, vect2_t size, void *u
     UNUSED(pos);
     UNUSED(size);
     
-    if(cap->tex == 0) return;
-    
-    mat4 proj_matrix, mv_matrix, pvm;
+    if(cap->ready < 0) return;
     
-    VERIFY3F(dr_getvf32(&win->proj_matrix, (float *)proj_matrix, 0, 16), ==, 16);
-	VERIFY3F(dr_getvf32(&win->mv_matrix, (float *)mv_matrix, 0, 16), ==, 16);
-	glm_mat4_mul(proj_matrix, mv_matrix, pvm);
+    mat4 pvm;
+    quad_pvm(pvm);
     
-    if(!win->shader) {
-		win->shader = shader_prog_from_text("panel_win_shader",
-		    vert_shader, frag_shader,
+    if(!cap->shader) {
+		cap->shader = shader_prog_from_text("panel_win_shader",
+		    quad_vert_shader, frag_shader,
 		    "vtx_pos", VTX_ATTRIB_POS,
 		    "vtx_tex0", VTX_ATTRIB_TEX0, NULL);
-		ASSERT(win->shader != 0);
+		ASSERT(cap->shader != 0);
     }
     
     
@@ -87,27 +473,32 @@ static void draw_cap_window(window_t *window, vect2_t pos, vect2_t size, void *u
         VECT2(pos.x + size.x, pos.y)
     };
     
-    if(win->cache == NULL) {
-        win->cache = glutils_cache_new(CACHE_SIZE);
-    }
-    
-    glutils_quads_t *quads = glutils_cache_get_2D_quads(win->cache, p, t, 4);
+    glutils_quads_t *quads = quad_get(p, t);
     
-    glUseProgram(win->shader);
-    XPLMBindTexture2d(cap->tex, 0);
-    glUniform1i(glGetUniformLocation(win->shader, "tex"), 0);
-	glUniformMatrix4fv(glGetUniformLocation(win->shader, "pvm"), 1, GL_FALSE, (const GLfloat *)pvm);
-	glutils_draw_quads(quads, win->shader);
-	XPLMBindTexture2d(0, 0);
-    glUseProgram(0);
+    gls_use_program(cap->shader);
+    gls_bind_texture_array(cap->tex[cap->ready], 0);
+    glUniform1i(glGetUniformLocation(cap->shader, "tex"), 0);
+    glUniform1f(glGetUniformLocation(cap->shader, "layer"), win->layer);
+	glUniformMatrix4fv(glGetUniformLocation(cap->shader, "pvm"), 1, GL_FALSE, (const GLfloat *)pvm);
+	glutils_draw_quads(quads, cap->shader);
 }
 
 window_t *panel_cap_add_window(panel_cap_t *cap, const char *name, const char *id, vect2_t pos, vect2_t size) {
+    return panel_cap_add_window2(cap, name, id, pos, size, 0);
+}
+
+window_t *panel_cap_add_window2(panel_cap_t *cap, const char *name, const char *id, vect2_t pos, vect2_t size,
+                                unsigned layer) {
+    ASSERT(cap);
+    ASSERT3U(layer, <, cap->num_sources);
     cap_window_t *win = safe_calloc(1, sizeof(*win));
     
     win->cap = cap;
     win->pos = pos;
     win->size = size;
+    win->layer = layer;
+    win->index = cap->num_windows++;
+    sig_reset(cap, win);
     
     window_conf_t conf = {
         .size = size,
@@ -120,9 +511,6 @@ window_t *panel_cap_add_window(panel_cap_t *cap, const char *name, const char *i
     lacf_strlcpy(conf.name, name, sizeof(conf.name));
     lacf_strlcpy(conf.id, id, sizeof(conf.id));
     
-	fdr_find(&win->proj_matrix, "sim/graphics/view/projection_matrix");
-	fdr_find(&win->mv_matrix, "sim/graphics/view/modelview_matrix");
-    
     win->window = window_new(&conf, win);
     
     list_insert_tail(&cap->windows, win);
@@ -130,35 +518,100 @@ window_t *panel_cap_add_window(panel_cap_t *cap, const char *name, const char *i
     return win->window;
 }
 
+// Picks the buffer to blit into: the oldest one that windows aren't drawing from and that the GPU
+// is done with. Returns -1 if every candidate still has a blit in flight.
+static int cap_pick_buffer(const panel_cap_t *cap) {
+    if(cap->num_buffers == 1) return 0;
+    
+    int buf = -1;
+    for(unsigned i = 0; i < cap->num_buffers; ++i) {
+        if((int)i == cap->ready || cap->fence[i]) continue;
+        if(buf < 0 || cap->seq[i] < cap->seq[buf]) buf = i;
+    }
+    return buf;
+}
+
+static bool panel_cap_is_shown(const panel_cap_t *cap) {
+    for(const cap_window_t *w = list_head(&cap->windows); w; w = list_next(&cap->windows, w)) {
+        if(window_is_visible(w->window)) return true;
+    }
+    return false;
+}
+
 void panel_cap_update(panel_cap_t *cap) {
     // UNUSED(cap);
     // return;
     
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, dr_geti(&cap->fbo_dr));
-    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    // Scheduled windows skip their draw callback on most frames, so only visibility says
+    // whether a window is still in use.
+    uint64_t now = microclock();
+    if(panel_cap_is_shown(cap)) cap->last_shown = now;
+    if(cap->evict_after && now - cap->last_shown > cap->evict_after) {
+        panel_cap_evict(cap);
+        return;
+    }
+    trace_begin("panel_cap_update");
+    
+    panel_cap_poll(cap);
     
-    if(cap->tex == 0) {
-        glGenTextures(1, &cap->tex);
-        glBindTexture(GL_TEXTURE_2D, cap->tex);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, cap->size.x, cap->size.y, 0, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    // When the GPU is a frame or more behind, skip this capture and let the fences retire.
+    int buf = cap_pick_buffer(cap);
+    if(buf < 0) {
+        trace_end("panel_cap_update");
+        return;
     }
     
-    if(cap->fbo == 0) {
-        glGenFramebuffers(1, &cap->fbo);
-        glBindFramebufferEXT(GL_FRAMEBUFFER, cap->fbo);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, cap->tex, 0);
+    gls_pass_begin();
+    cap->evicted = false;
+    
+    if(cap->tex[buf] == 0) {
+        // Every buffer gets the same format, so only the first one created picks it.
+        if(!cap->internal_format) {
+            GLuint src = dr_geti(&cap->fbo_dr);
+            gls_bind_framebuffer(GL_READ_FRAMEBUFFER, src);
+            cap->internal_format = cap_internal_format(cap, src);
+        }
+        
+        // No pixels are uploaded, so the client format only has to be valid.
+        glGenTextures(1, &cap->tex[buf]);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, cap->tex[buf]);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, cap->internal_format, cap->size.x, cap->size.y, cap->num_sources, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        gls_invalidate();
     }
     
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, cap->fbo);
-    glDrawBuffer(GL_COLOR_ATTACHMENT0);
-
-    // Copy the pixels over
-    glBlitFramebuffer(
-        0, 0, cap->size.x, cap->size.y,
-        0, 0, cap->size.x, cap->size.y,
-        GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    for(unsigned layer = 0; layer < cap->num_sources; ++layer) {
+        // One framebuffer per layer, so attachments never change once set up.
+        if(cap->fbo[buf][layer] == 0) {
+            glGenFramebuffers(1, &cap->fbo[buf][layer]);
+            gls_bind_framebuffer(GL_DRAW_FRAMEBUFFER, cap->fbo[buf][layer]);
+            glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, cap->tex[buf], 0, layer);
+            // The draw buffer is part of the FBO's state, so it only needs setting once.
+            glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        }
+        
+        GLuint src = layer ? cap->sources[layer] : (GLuint)dr_geti(&cap->fbo_dr);
+        gls_bind_framebuffer(GL_READ_FRAMEBUFFER, src);
+        gls_read_buffer(GL_COLOR_ATTACHMENT0);
+        gls_bind_framebuffer(GL_DRAW_FRAMEBUFFER, cap->fbo[buf][layer]);
         
-    glBindFramebuffer(GL_FRAMEBUFFER, dr_geti(&cap->fbo_dr));
+        // Copy the pixels over
+        glBlitFramebuffer(
+            0, 0, cap->size.x, cap->size.y,
+            0, 0, cap->size.x, cap->size.y,
+            GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+    
+    ASSERT(!cap->fence[buf]);
+    cap->fence[buf] = cap->num_buffers > 1 ? glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) : 0;
+    cap->seq[buf] = cap->next_seq++;
+    if(cap->num_buffers == 1) cap->ready = buf;
+    
+    if(cap->detect) sig_update(cap, buf);
+    
+    gls_pass_end();
+    trace_end("panel_cap_update");
 }
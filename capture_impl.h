@@ -19,13 +19,73 @@
 #include <acfutils/glutils.h>
 #include <acfutils/shader.h>
 #include <window/capture.h>
+#include "glstate_impl.h"
+#include "quad_impl.h"
+#include "trace_impl.h"
 
+#define CAP_MAX_BUFFERS (4)
+#define CAP_MAX_SOURCES (8)
+#define CAP_SIG_TILES (8)              // Change detection grid, per side. Hardcoded in the sig shaders
+#define CAP_SIG_SPLIT (8)              // Parts per tile side in the first pass. Hardcoded too
+#define CAP_SIG_READBACKS (2)
+
+// Change detection hashes every texel of a window's region in two passes. The first hashes each
+// tile in 8x8 parts into sig_part_tex, the second hashes each tile's parts into one RG32UI texel
+// of sig_tex, one 8x8 block per window. That is read back through a pixel buffer once the fence
+// behind it has signalled.
+typedef struct {
+    GLuint      pbo;
+    GLsync      fence;
+    unsigned    windows;        // Number of window blocks in the readback
+} cap_readback_t;
+
+// With more than one buffer, each update blits into the oldest texture that is neither being
+// sampled nor still in flight, and drops a fence behind it; windows sample the newest texture
+// whose fence has signalled, so the blit and the composite never touch the same texture in
+// flight. If no texture is free, the update is skipped.
+//
+// Each buffer is an array texture with one layer per source; layer 0 is the sim's current FBO,
+// the others are client FBOs. Every window samples its layer from the same texture with the same
+// program, so a panel needs one texture and one program however many sources it has. Each window
+// still draws in its own pass, which binds them again.
 struct panel_cap_t {
     dr_t fbo_dr;
     vect2_t size;
-    GLuint tex;
-    GLuint fbo;
+    
+    unsigned num_sources;
+    GLuint sources[CAP_MAX_SOURCES];    // sources[0] is unused, layer 0 reads fbo_dr
+    
+    panel_cap_format_t format;
+    GLenum internal_format;             // Chosen when the textures are created, 0 until then
+    
+    unsigned num_buffers;
+    GLuint tex[CAP_MAX_BUFFERS];
+    GLuint fbo[CAP_MAX_BUFFERS][CAP_MAX_SOURCES];
+    GLsync fence[CAP_MAX_BUFFERS];
+    uint64_t seq[CAP_MAX_BUFFERS];  // Update that last blitted into the buffer, 0 if never
+    uint64_t next_seq;
+    int ready;                      // Newest buffer whose blit has completed, or -1
+    bool evicted;                   // No GL resources allocated
+    
+    GLuint shader;
+    
     list_t windows;
+    unsigned num_windows;
+    
+    bool detect;
+    GLuint sig_part_shader;
+    GLuint sig_part_tex;
+    GLuint sig_part_fbo;
+    GLuint sig_shader;
+    GLuint sig_tex;
+    GLuint sig_fbo;
+    unsigned sig_windows;           // Number of window blocks the sig textures were created for
+    uint64_t sig_seq;               // Bumped for every readback collected
+    cap_readback_t readback[CAP_SIG_READBACKS];
+    unsigned next_readback;
+    
+    uint64_t last_shown;            // Last update with any of the windows visible
+    uint64_t evict_after;
 };
 
 typedef struct {
@@ -34,32 +94,88 @@ typedef struct {
     window_t        *window;
     vect2_t         pos;
     vect2_t         size;
-
-    GLuint          shader;
-    glutils_cache_t *cache;
-    dr_t            proj_matrix;
-    dr_t            mv_matrix;
+    unsigned        layer;
+    unsigned        index;          // Order the window was added in
+    
+    bool            has_sig;
+    uint32_t        sig[CAP_SIG_TILES * CAP_SIG_TILES][2];
+    uint64_t        changed[CAP_SIG_TILES * CAP_SIG_TILES];    // sig_seq of each tile's last change
     
     list_node_t list;
 } cap_window_t;
 
-static const char *vert_shader =
+static const char *frag_shader =
     "#version 120\n"
-    "uniform mat4       pvm;\n"
-    "attribute vec3     vtx_pos;\n"
-    "attribute vec2     vtx_tex0;\n"
+    "#extension GL_EXT_texture_array : require\n"
+    "uniform sampler2DArray tex;\n"
+    "uniform float      layer;\n"
     "varying vec2       tex_coord;\n"
     "void main() {\n"
-    "   tex_coord = vtx_tex0;\n"
+    "   gl_FragColor = texture2DArray(tex, vec3(tex_coord, layer));\n"
+    "}\n";
+
+// The signature passes only need integer maths and texel fetches, hence GLSL 1.30.
+static const char *sig_vert_shader =
+    "#version 130\n"
+    "uniform mat4       pvm;\n"
+    "in vec3            vtx_pos;\n"
+    "void main() {\n"
     "   gl_Position = pvm * vec4(vtx_pos, 1.0);\n"
     "}\n";
 
-static const char *frag_shader =
-    "#version 120\n"
-    "uniform sampler2D  tex;\n"
-    "varying vec2       tex_coord;\n"
+#define SIG_MIX_GLSL \
+    "uvec2 sig_mix(uvec2 h, uint v) {\n" \
+    "   h = uvec2((h.x ^ v) * 0x9E3779B1u, (h.y + v) * 0x85EBCA77u);\n" \
+    "   return h ^ (h >> uvec2(15u, 13u));\n" \
+    "}\n"
+
+// Hashes every texel of one part of a tile, in order, so that any change to a texel, down to
+// 16 bits per channel, changes the hash. `region` is the window's region in texels, and `base`
+// the first row of its block.
+static const char *sig_part_frag_shader =
+    "#version 130\n"
+    "uniform sampler2DArray tex;\n"
+    "uniform int        layer;\n"
+    "uniform ivec4      region;\n"
+    "uniform int        base;\n"
+    "out uvec2          sig;\n"
+    SIG_MIX_GLSL
+    "void main() {\n"
+    "   ivec2 cell = ivec2(gl_FragCoord.xy) - ivec2(0, base);\n"
+    "   ivec2 tile = cell / 8;\n"
+    "   ivec2 part = cell % 8;\n"
+    "   ivec2 t0 = region.xy + tile * region.zw / 8;\n"
+    "   ivec2 t1 = region.xy + (tile + 1) * region.zw / 8;\n"
+    "   ivec2 p0 = t0 + part * (t1 - t0) / 8;\n"
+    "   ivec2 p1 = t0 + (part + 1) * (t1 - t0) / 8;\n"
+    "   uvec2 h = uvec2(0u);\n"
+    "   for(int y = p0.y; y < p1.y; ++y) {\n"
+    "       for(int x = p0.x; x < p1.x; ++x) {\n"
+    "           uvec4 c = uvec4(texelFetch(tex, ivec3(x, y, layer), 0) * 65535.0 + 0.5);\n"
+    "           h = sig_mix(h, c.r | (c.g << 16));\n"
+    "           h = sig_mix(h, c.b | (c.a << 16));\n"
+    "       }\n"
+    "   }\n"
+    "   sig = h;\n"
+    "}\n";
+
+// Hashes the 8x8 part hashes of a tile into the tile's signature.
+static const char *sig_frag_shader =
+    "#version 130\n"
+    "uniform usampler2D parts;\n"
+    "out uvec2          sig;\n"
+    SIG_MIX_GLSL
     "void main() {\n"
-    "   gl_FragColor = texture2D(tex, tex_coord);\n"
+    "   ivec2 base = ivec2(gl_FragCoord.xy) * 8;\n"
+    "   uvec2 h = uvec2(0u);\n"
+    "   for(int j = 0; j < 8; ++j) {\n"
+    "       for(int i = 0; i < 8; ++i) {\n"
+    "           uvec2 part = texelFetch(parts, base + ivec2(i, j), 0).rg;\n"
+    "           h = sig_mix(h, part.x);\n"
+    "           h = sig_mix(h, part.y);\n"
+    "       }\n"
+    "   }\n"
+    "   sig = h;\n"
     "}\n";
 
 #endif /* ifndef _CAPTURE_IMPL_H_ */
@@ -0,0 +1,168 @@
+/*===--------------------------------------------------------------------------------------------===
+ * glstate.c
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2024 Amy Parent. All rights reserved
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+#include "glstate_impl.h"
+
+#include <acfutils/assert.h>
+#include <acfutils/dr.h>
+#include <XPLMGraphics.h>
+
+#define MAX_UNITS (4)
+
+enum {
+    GLS_PROGRAM     = 1 << 0,
+    GLS_READ_FBO    = 1 << 1,
+    GLS_DRAW_FBO    = 1 << 2,
+    GLS_READ_BUF    = 1 << 3,
+    GLS_TEXTURE     = 1 << 4,   // One bit per texture unit from here up
+    GLS_TEX_ARRAY   = GLS_TEXTURE << MAX_UNITS,
+};
+
+static struct {
+    bool                has_dr;
+    dr_t                fbo_dr;
+    
+    int                 depth;
+    unsigned            known;  // Bindings whose current value we know
+    unsigned            dirty;  // Bindings changed since the outermost pass began
+    
+    GLuint              program;
+    GLuint              read_fbo;
+    GLuint              draw_fbo;
+    GLenum              read_buf;
+    GLuint              tex[MAX_UNITS];
+    GLuint              tex_array[MAX_UNITS];
+    
+    window_gl_stats_t   stats;
+} gls = {};
+
+static bool gls_skip(unsigned bit, bool same) {
+    if((gls.known & bit) && same) {
+        gls.stats.skipped += 1;
+        return true;
+    }
+    gls.known |= bit;
+    gls.dirty |= bit;
+    gls.stats.issued += 1;
+    return false;
+}
+
+void gls_use_program(GLuint program) {
+    if(gls_skip(GLS_PROGRAM, gls.program == program)) return;
+    gls.program = program;
+    glUseProgram(program);
+}
+
+void gls_bind_texture(GLuint tex, int unit) {
+    ASSERT3S(unit, >=, 0);
+    ASSERT3S(unit, <, MAX_UNITS);
+    
+    if(gls_skip(GLS_TEXTURE << unit, gls.tex[unit] == tex)) return;
+    gls.tex[unit] = tex;
+    XPLMBindTexture2d(tex, unit);
+}
+
+// XPLM only knows about 2D textures, so array textures are bound by hand. The sim expects unit 0
+// to be active, so it is put back afterwards.
+void gls_bind_texture_array(GLuint tex, int unit) {
+    ASSERT3S(unit, >=, 0);
+    ASSERT3S(unit, <, MAX_UNITS);
+    
+    if(gls_skip(GLS_TEX_ARRAY << unit, gls.tex_array[unit] == tex)) return;
+    gls.tex_array[unit] = tex;
+    if(unit) glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, tex);
+    if(unit) glActiveTexture(GL_TEXTURE0);
+}
+
+void gls_bind_framebuffer(GLenum target, GLuint fbo) {
+    switch(target) {
+    case GL_READ_FRAMEBUFFER:
+        if(gls_skip(GLS_READ_FBO, gls.read_fbo == fbo)) return;
+        gls.read_fbo = fbo;
+        gls.known &= ~GLS_READ_BUF;
+        break;
+    
+    case GL_DRAW_FRAMEBUFFER:
+        if(gls_skip(GLS_DRAW_FBO, gls.draw_fbo == fbo)) return;
+        gls.draw_fbo = fbo;
+        break;
+    
+    default:
+        ASSERT3U(target, ==, GL_FRAMEBUFFER);
+        if((gls.known & GLS_READ_FBO) && (gls.known & GLS_DRAW_FBO) && gls.read_fbo == fbo && gls.draw_fbo == fbo) {
+            gls.stats.skipped += 1;
+            return;
+        }
+        gls.stats.issued += 1;
+        gls.known |= GLS_READ_FBO | GLS_DRAW_FBO;
+        gls.dirty |= GLS_READ_FBO | GLS_DRAW_FBO;
+        gls.known &= ~GLS_READ_BUF;
+        gls.read_fbo = fbo;
+        gls.draw_fbo = fbo;
+        break;
+    }
+    glBindFramebuffer(target, fbo);
+}
+
+// The read buffer belongs to the bound read framebuffer, so it is forgotten whenever that changes.
+void gls_read_buffer(GLenum buffer) {
+    if(gls_skip(GLS_READ_BUF, gls.read_buf == buffer)) return;
+    gls.read_buf = buffer;
+    glReadBuffer(buffer);
+}
+
+void gls_invalidate(void) {
+    gls.known = 0;
+}
+
+void gls_pass_begin(void) {
+    if(gls.depth++) return;
+    
+    // The sim may have done anything since the last pass.
+    gls.known = 0;
+    gls.dirty = 0;
+}
+
+void gls_pass_end(void) {
+    ASSERT3S(gls.depth, >, 0);
+    if(--gls.depth) return;
+    
+    unsigned dirty = gls.dirty;
+    if(dirty & GLS_PROGRAM) gls_use_program(0);
+    for(int i = 0; i < MAX_UNITS; ++i) {
+        if(dirty & (GLS_TEXTURE << i)) gls_bind_texture(0, i);
+        if(dirty & (GLS_TEX_ARRAY << i)) gls_bind_texture_array(0, i);
+    }
+    
+    if(dirty & (GLS_READ_FBO | GLS_DRAW_FBO)) {
+        if(!gls.has_dr) {
+            fdr_find(&gls.fbo_dr, "sim/graphics/view/current_gl_fbo");
+            gls.has_dr = true;
+        }
+        GLuint fbo = dr_geti(&gls.fbo_dr);
+        if((dirty & GLS_READ_FBO) && (dirty & GLS_DRAW_FBO)) {
+            gls_bind_framebuffer(GL_FRAMEBUFFER, fbo);
+        } else if(dirty & GLS_READ_FBO) {
+            gls_bind_framebuffer(GL_READ_FRAMEBUFFER, fbo);
+        } else {
+            gls_bind_framebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+        }
+    }
+    gls.dirty = 0;
+}
+
+void window_sys_get_gl_stats(window_gl_stats_t *stats) {
+    ASSERT3P(stats, !=, NULL);
+    *stats = gls.stats;
+}
+
+void window_sys_reset_gl_stats(void) {
+    memset(&gls.stats, 0, sizeof(gls.stats));
+}
@@ -0,0 +1,32 @@
+/*===--------------------------------------------------------------------------------------------===
+ * glstate_impl.h
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2024 Amy Parent
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+#ifndef _GLSTATE_IMPL_H_
+#define _GLSTATE_IMPL_H_
+
+#include <acfutils/glew.h>
+#include <window/window.h>
+
+// Cache of the GL bindings libwindow touches. Inside a pass (one window draw, one capture update),
+// binds that wouldn't change anything are skipped, and nothing is unbound until the pass ends;
+// gls_pass_end then puts back what the sim expects (no program, no texture, the sim's FBO) for
+// whatever was changed. Passes nest. Anything that might make GL calls behind our back (user
+// callbacks, XPLM drawing) must be followed by gls_invalidate().
+
+void gls_pass_begin(void);
+void gls_pass_end(void);
+void gls_invalidate(void);
+
+void gls_use_program(GLuint program);
+void gls_bind_texture(GLuint tex, int unit);
+void gls_bind_texture_array(GLuint tex, int unit);
+void gls_bind_framebuffer(GLenum target, GLuint fbo);
+void gls_read_buffer(GLenum buffer);
+
+#endif /* ifndef _GLSTATE_IMPL_H_ */
@@ -0,0 +1,277 @@
+/*===--------------------------------------------------------------------------------------------===
+ * image.c
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2024 Amy Parent. All rights reserved
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+#include "window_impl.h"
+#include <window/image.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/avl.h>
+#include <acfutils/list.h>
+#include <acfutils/log.h>
+#include <acfutils/png.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/thread.h>
+#include <XPLMGraphics.h>
+
+#define NUM_WORKERS (2)
+
+typedef enum {
+    IMAGE_QUEUED,
+    IMAGE_DECODING,
+    IMAGE_DECODED,
+    IMAGE_FAILED,
+} image_state_t;
+
+struct window_image_t {
+    char            *path;
+    unsigned        refs;
+    
+    // Protected by img.lock
+    image_state_t   state;
+    bool            orphan;     // Released while a worker was decoding it
+    uint8_t         *pixels;
+    int             width;
+    int             height;
+    
+    // Sim thread only
+    bool            uploaded;
+    GLuint          tex;
+    
+    avl_node_t      cache_node;
+    list_node_t     job_node;
+};
+
+static struct {
+    bool            is_init;
+    
+    mutex_t         lock;
+    condvar_t       cv;
+    bool            stop;
+    thread_t        workers[NUM_WORKERS];
+    list_t          jobs;
+    avl_tree_t      cache;
+} img = {};
+
+static int image_cmp(const void *p1, const void *p2) {
+    const window_image_t *i1 = p1;
+    const window_image_t *i2 = p2;
+    
+    int result = strcmp(i1->path, i2->path);
+    if(result < 0) return -1;
+    if(result > 0) return 1;
+    return 0;
+}
+
+static void image_free(window_image_t *image) {
+    if(image->tex) glDeleteTextures(1, &image->tex);
+    lacf_free(image->pixels);
+    lacf_free(image->path);
+    lacf_free(image);
+}
+
+static void image_worker(void *refcon) {
+    UNUSED(refcon);
+    
+    mutex_enter(&img.lock);
+    while(!img.stop) {
+        window_image_t *image = list_remove_head(&img.jobs);
+        if(!image) {
+            cv_wait(&img.cv, &img.lock);
+            continue;
+        }
+        image->state = IMAGE_DECODING;
+        mutex_exit(&img.lock);
+        
+        int width = 0, height = 0;
+        trace_begin("image_decode");
+        uint8_t *pixels = png_load_from_file_rgba(image->path, &width, &height);
+        trace_end("image_decode");
+        if(!pixels) logMsg("could not load image `%s`", image->path);
+        
+        mutex_enter(&img.lock);
+        if(image->orphan) {
+            lacf_free(pixels);
+            image_free(image);
+            continue;
+        }
+        image->pixels = pixels;
+        image->width = width;
+        image->height = height;
+        image->state = pixels ? IMAGE_DECODED : IMAGE_FAILED;
+    }
+    mutex_exit(&img.lock);
+}
+
+void image_sys_init(void) {
+    if(img.is_init) return;
+    
+    mutex_init(&img.lock);
+    cv_init(&img.cv);
+    list_create(&img.jobs, sizeof(window_image_t), offsetof(window_image_t, job_node));
+    avl_create(&img.cache, image_cmp, sizeof(window_image_t), offsetof(window_image_t, cache_node));
+    
+    img.stop = false;
+    for(int i = 0; i < NUM_WORKERS; ++i) {
+        VERIFY(thread_create(&img.workers[i], image_worker, NULL));
+    }
+    img.is_init = true;
+}
+
+void image_sys_fini(void) {
+    if(!img.is_init) return;
+    img.is_init = false;
+    
+    mutex_enter(&img.lock);
+    img.stop = true;
+    cv_broadcast(&img.cv);
+    mutex_exit(&img.lock);
+    for(int i = 0; i < NUM_WORKERS; ++i) {
+        thread_join(&img.workers[i]);
+    }
+    
+    while(list_remove_head(&img.jobs) != NULL) {}
+    list_destroy(&img.jobs);
+    
+    window_image_t *image = NULL;
+    void *cookie = NULL;
+    while((image = avl_destroy_nodes(&img.cache, &cookie)) != NULL) {
+        logMsg("image `%s` still has %u references at shutdown", image->path, image->refs);
+        image_free(image);
+    }
+    avl_destroy(&img.cache);
+    
+    cv_destroy(&img.cv);
+    mutex_destroy(&img.lock);
+}
+
+window_image_t *window_image_get(const char *path) {
+    ASSERT3P(path, !=, NULL);
+    VERIFY(img.is_init);
+    
+    window_image_t key = {.path = (char *)path};
+    avl_index_t where;
+    
+    mutex_enter(&img.lock);
+    window_image_t *image = avl_find(&img.cache, &key, &where);
+    if(image) {
+        image->refs += 1;
+        mutex_exit(&img.lock);
+        return image;
+    }
+    
+    image = safe_calloc(1, sizeof(*image));
+    image->path = safe_strdup(path);
+    image->refs = 1;
+    image->state = IMAGE_QUEUED;
+    avl_insert(&img.cache, image, where);
+    list_insert_tail(&img.jobs, image);
+    cv_signal(&img.cv);
+    mutex_exit(&img.lock);
+    
+    return image;
+}
+
+void window_image_release(window_image_t *image) {
+    if(!image) return;
+    VERIFY(img.is_init);
+    
+    mutex_enter(&img.lock);
+    ASSERT3U(image->refs, >, 0);
+    if(--image->refs) {
+        mutex_exit(&img.lock);
+        return;
+    }
+    
+    avl_remove(&img.cache, image);
+    switch(image->state) {
+    case IMAGE_QUEUED:
+        list_remove(&img.jobs, image);
+        image_free(image);
+        break;
+    case IMAGE_DECODING:
+        image->orphan = true;
+        break;
+    case IMAGE_DECODED:
+    case IMAGE_FAILED:
+        image_free(image);
+        break;
+    }
+    mutex_exit(&img.lock);
+}
+
+bool window_image_is_ready(const window_image_t *image) {
+    ASSERT3P(image, !=, NULL);
+    if(image->uploaded) return true;
+    
+    mutex_enter(&img.lock);
+    bool ready = image->state == IMAGE_DECODED;
+    mutex_exit(&img.lock);
+    return ready;
+}
+
+static bool image_upload(window_image_t *image) {
+    mutex_enter(&img.lock);
+    bool decoded = image->state == IMAGE_DECODED;
+    mutex_exit(&img.lock);
+    if(!decoded) return false;
+    
+    // Once decoded, the pixels are only touched from the sim thread.
+    glGenTextures(1, &image->tex);
+    glBindTexture(GL_TEXTURE_2D, image->tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image->width, image->height, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, image->pixels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    gls_invalidate();
+    
+    lacf_free(image->pixels);
+    image->pixels = NULL;
+    image->uploaded = true;
+    return true;
+}
+
+void window_image_draw(window_image_t *image, vect2_t pos, vect2_t size, double alpha) {
+    ASSERT3P(image, !=, NULL);
+    if(!image->uploaded && !image_upload(image)) return;
+    
+    mat4 pvm;
+    quad_pvm(pvm);
+    
+    // PNG rows are stored top first, so the texture is upside down.
+    const vect2_t t[4] = {
+        VECT2(0, 1),
+        VECT2(0, 0),
+        VECT2(1, 0),
+        VECT2(1, 1)
+    };
+    
+    const vect2_t p[4] = {
+        VECT2(pos.x, pos.y),
+        VECT2(pos.x, pos.y + size.y),
+        VECT2(pos.x + size.x, pos.y + size.y),
+        VECT2(pos.x + size.x, pos.y)
+    };
+    
+    XPLMSetGraphicsState(0, 1, 0, 0, 1, 0, 0);
+    quad_draw(image->tex, pvm, p, t, alpha);
+}
+
+void window_image_get_gl_mem(window_gl_mem_t *mem) {
+    ASSERT3P(mem, !=, NULL);
+    memset(mem, 0, sizeof(*mem));
+    if(!img.is_init) return;
+    
+    for(window_image_t *image = avl_first(&img.cache); image != NULL;
+        image = AVL_NEXT(&img.cache, image)) {
+        if(!image->tex) continue;
+        mem->textures += 1;
+        mem->texture_bytes += (size_t)image->width * (size_t)image->height * 4;
+    }
+}
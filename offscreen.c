@@ -0,0 +1,137 @@
+/*===--------------------------------------------------------------------------------------------===
+ * offscreen.c
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2024 Amy Parent. All rights reserved
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+#include "window_impl.h"
+
+#include <acfutils/assert.h>
+#include <acfutils/log.h>
+#include <XPLMGraphics.h>
+
+static void offscreen_free_target(offscreen_t *off) {
+    if(off->fbo) glDeleteFramebuffers(1, &off->fbo);
+    if(off->tex) glDeleteTextures(1, &off->tex);
+    off->fbo = 0;
+    off->tex = 0;
+    off->size = VECT2(0, 0);
+}
+
+static bool offscreen_alloc_target(offscreen_t *off, vect2_t size) {
+    glGenTextures(1, &off->tex);
+    glBindTexture(GL_TEXTURE_2D, off->tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    gls_invalidate();
+    
+    glGenFramebuffers(1, &off->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, off->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, off->tex, 0);
+    
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        logMsg("could not create %dx%d offscreen window target", (int)size.x, (int)size.y);
+        glBindFramebuffer(GL_FRAMEBUFFER, off->prev_fbo);
+        offscreen_free_target(off);
+        return false;
+    }
+    off->size = size;
+    return true;
+}
+
+bool offscreen_begin(offscreen_t *off, vect2_t size) {
+    ASSERT3P(off, !=, NULL);
+    
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &off->prev_fbo);
+    glGetIntegerv(GL_VIEWPORT, off->prev_viewport);
+    
+    if(off->fbo && (off->size.x != size.x || off->size.y != size.y)) {
+        offscreen_free_target(off);
+    }
+    if(!off->fbo && !offscreen_alloc_target(off, size)) return false;
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, off->fbo);
+    glViewport(0, 0, size.x, size.y);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    
+    // Content blended over the cleared target comes out with premultiplied alpha, as long as
+    // alpha itself accumulates as coverage.
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(0, size.x, 0, size.y, -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+    quad_begin_target(size);
+    return true;
+}
+
+void offscreen_end(offscreen_t *off) {
+    ASSERT3P(off, !=, NULL);
+    
+    quad_end_target();
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopMatrix();
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, off->prev_fbo);
+    glViewport(off->prev_viewport[0], off->prev_viewport[1], off->prev_viewport[2], off->prev_viewport[3]);
+}
+
+void offscreen_draw(offscreen_t *off, vect2_t pos, vect2_t size) {
+    ASSERT3P(off, !=, NULL);
+    if(!off->tex) return;
+    
+    mat4 pvm;
+    quad_pvm(pvm);
+    
+    const vect2_t t[4] = {
+        VECT2(0, 0),
+        VECT2(0, 1),
+        VECT2(1, 1),
+        VECT2(1, 0)
+    };
+    
+    const vect2_t p[4] = {
+        VECT2(pos.x, pos.y),
+        VECT2(pos.x, pos.y + size.y),
+        VECT2(pos.x + size.x, pos.y + size.y),
+        VECT2(pos.x + size.x, pos.y)
+    };
+    
+    // The target holds premultiplied alpha, which the usual blend function would apply twice.
+    XPLMSetGraphicsState(0, 1, 0, 0, 1, 0, 0);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    quad_draw(off->tex, pvm, p, t, 1.0);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+void offscreen_get_gl_mem(const offscreen_t *off, window_gl_mem_t *mem) {
+    ASSERT3P(off, !=, NULL);
+    ASSERT3P(mem, !=, NULL);
+    
+    if(off->tex) {
+        mem->textures += 1;
+        mem->texture_bytes += (size_t)off->size.x * (size_t)off->size.y * 4;
+    }
+    if(off->fbo) mem->framebuffers += 1;
+}
+
+void offscreen_fini(offscreen_t *off) {
+    ASSERT3P(off, !=, NULL);
+    
+    offscreen_free_target(off);
+}
@@ -0,0 +1,121 @@
+/*===--------------------------------------------------------------------------------------------===
+ * quad.c
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2024 Amy Parent. All rights reserved
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+#include "quad_impl.h"
+#include "glstate_impl.h"
+
+#include <acfutils/assert.h>
+#include <acfutils/dr.h>
+#include <acfutils/shader.h>
+
+#define CACHE_SIZE (1 << 14)
+
+const char *quad_vert_shader =
+    "#version 120\n"
+    "uniform mat4       pvm;\n"
+    "attribute vec3     vtx_pos;\n"
+    "attribute vec2     vtx_tex0;\n"
+    "varying vec2       tex_coord;\n"
+    "void main() {\n"
+    "   tex_coord = vtx_tex0;\n"
+    "   gl_Position = pvm * vec4(vtx_pos, 1.0);\n"
+    "}\n";
+
+static const char *frag_shader =
+    "#version 120\n"
+    "uniform sampler2D  tex;\n"
+    "uniform float      alpha;\n"
+    "varying vec2       tex_coord;\n"
+    "void main() {\n"
+    "   vec4 color = texture2D(tex, tex_coord);\n"
+    "   gl_FragColor = vec4(color.rgb, color.a * alpha);\n"
+    "}\n";
+
+static struct {
+    bool            has_dr;
+    dr_t            proj_matrix;
+    dr_t            mv_matrix;
+    
+    GLuint          program;
+    glutils_cache_t *cache;
+    
+    bool            has_target;
+    vect2_t         target;
+} quad = {};
+
+void quad_begin_target(vect2_t size) {
+    ASSERT(!quad.has_target);
+    quad.has_target = true;
+    quad.target = size;
+}
+
+void quad_end_target(void) {
+    ASSERT(quad.has_target);
+    quad.has_target = false;
+}
+
+void quad_pvm(mat4 pvm) {
+    if(quad.has_target) {
+        glm_ortho(0, quad.target.x, 0, quad.target.y, -1, 1, pvm);
+        return;
+    }
+    
+    if(!quad.has_dr) {
+        fdr_find(&quad.proj_matrix, "sim/graphics/view/projection_matrix");
+        fdr_find(&quad.mv_matrix, "sim/graphics/view/modelview_matrix");
+        quad.has_dr = true;
+    }
+    
+    mat4 proj_matrix, mv_matrix;
+    VERIFY3F(dr_getvf32(&quad.proj_matrix, (float *)proj_matrix, 0, 16), ==, 16);
+    VERIFY3F(dr_getvf32(&quad.mv_matrix, (float *)mv_matrix, 0, 16), ==, 16);
+    glm_mat4_mul(proj_matrix, mv_matrix, pvm);
+}
+
+glutils_quads_t *quad_get(const vect2_t p[4], const vect2_t t[4]) {
+    if(!quad.cache) {
+        quad.cache = glutils_cache_new(CACHE_SIZE);
+    }
+    return glutils_cache_get_2D_quads(quad.cache, p, t, 4);
+}
+
+void quad_draw(GLuint tex, mat4 pvm, const vect2_t p[4], const vect2_t t[4], double alpha) {
+    if(!quad.program) {
+        quad.program = shader_prog_from_text("window_quad_shader",
+            quad_vert_shader, frag_shader,
+            "vtx_pos", VTX_ATTRIB_POS,
+            "vtx_tex0", VTX_ATTRIB_TEX0, NULL);
+        ASSERT(quad.program != 0);
+    }
+    glutils_quads_t *quads = quad_get(p, t);
+    
+    gls_use_program(quad.program);
+    gls_bind_texture(tex, 0);
+    glUniform1i(glGetUniformLocation(quad.program, "tex"), 0);
+    glUniform1f(glGetUniformLocation(quad.program, "alpha"), alpha);
+    glUniformMatrix4fv(glGetUniformLocation(quad.program, "pvm"), 1, GL_FALSE, (const GLfloat *)pvm);
+    glutils_draw_quads(quads, quad.program);
+}
+
+void quad_get_gl_mem(window_gl_mem_t *mem) {
+    ASSERT3P(mem, !=, NULL);
+    
+    if(quad.program) mem->programs += 1;
+    if(quad.cache) {
+        mem->caches += 1;
+        mem->cache_bytes += CACHE_SIZE;
+    }
+}
+
+void quad_sys_fini(void) {
+    if(quad.program) glDeleteProgram(quad.program);
+    if(quad.cache) glutils_cache_destroy(quad.cache);
+    quad.program = 0;
+    quad.cache = NULL;
+}
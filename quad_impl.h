@@ -0,0 +1,34 @@
+/*===--------------------------------------------------------------------------------------------===
+ * quad_impl.h
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2024 Amy Parent
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+#ifndef _QUAD_IMPL_H_
+#define _QUAD_IMPL_H_
+
+#include <acfutils/glew.h>
+#include <acfutils/glutils.h>
+#include <window/window.h>
+
+// Textured quads, which is all libwindow ever draws. Every module shares one vertex shader, one
+// program for plain 2D textures, one quad cache and one lookup of the sim's matrix datarefs.
+// Resources are created on first use and freed by quad_sys_fini().
+
+// Takes `pvm`, `vtx_pos` and `vtx_tex0`, and passes `tex_coord` on to the fragment shader.
+extern const char *quad_vert_shader;
+
+// While an offscreen target is bound, quads are drawn in its pixel space instead of the sim's.
+void quad_begin_target(vect2_t size);
+void quad_end_target(void);
+void quad_pvm(mat4 pvm);
+glutils_quads_t *quad_get(const vect2_t p[4], const vect2_t t[4]);
+void quad_draw(GLuint tex, mat4 pvm, const vect2_t p[4], const vect2_t t[4], double alpha);
+
+void quad_get_gl_mem(window_gl_mem_t *mem);
+void quad_sys_fini(void);
+
+#endif /* ifndef _QUAD_IMPL_H_ */
@@ -0,0 +1,280 @@
+/*===--------------------------------------------------------------------------------------------===
+ * record.c
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2024 Amy Parent. All rights reserved
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+#include "window_impl.h"
+#include <window/record.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/log.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/time.h>
+#include <stdio.h>
+
+#if IBM
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define REC_MAGIC (0x4357574cu) // 'LWWC'
+#define REC_VERSION (2)
+#define REC_MAX_WINDOWS (UINT16_MAX)
+
+// Window ids are only written once per recording: the first event that targets a window is
+// preceded by a REC_DEF record carrying its id, and every event after that refers to the window
+// by index.
+enum {
+    REC_DEF = 0xff
+};
+
+typedef struct {
+    uint32_t    magic;
+    uint32_t    version;
+} rec_header_t;
+
+typedef struct {
+    uint64_t    time;
+    int32_t     x;
+    int32_t     y;
+    int32_t     result;
+    uint16_t    window;
+    uint8_t     type;
+    uint8_t     status;     // Mouse status, or key flags
+    uint8_t     key;
+    uint8_t     vkey;
+    uint8_t     lose;
+    uint8_t     route;
+} rec_event_t;
+
+typedef char rec_id_t[sizeof(((window_conf_t *)NULL)->id)];
+
+static struct {
+    FILE            *file;
+    uint64_t        start;
+    
+    const window_t  **windows;
+    size_t          num_windows;
+} rec = {};
+
+bool window_rec_start(const char *path) {
+    ASSERT3P(path, !=, NULL);
+    if(rec.file) window_rec_stop();
+    
+    rec.file = fopen(path, "wb");
+    if(!rec.file) {
+        logMsg("could not open input recording `%s`", path);
+        return false;
+    }
+    
+    rec_header_t header = {.magic = REC_MAGIC, .version = REC_VERSION};
+    fwrite(&header, sizeof(header), 1, rec.file);
+    rec.start = microclock();
+    return true;
+}
+
+void window_rec_stop(void) {
+    if(!rec.file) return;
+    fclose(rec.file);
+    lacf_free(rec.windows);
+    
+    rec.file = NULL;
+    rec.windows = NULL;
+    rec.num_windows = 0;
+}
+
+bool window_rec_is_active(void) {
+    return rec.file != NULL;
+}
+
+void rec_fini(void) {
+    window_rec_stop();
+}
+
+// Window slots are recycled, so a window created after this one was destroyed may end up at the
+// same address. It must get an index of its own.
+void rec_forget(const window_t *window) {
+    for(size_t i = 0; i < rec.num_windows; ++i) {
+        if(rec.windows[i] == window) rec.windows[i] = NULL;
+    }
+}
+
+static uint16_t rec_window_index(const window_t *window) {
+    for(size_t i = 0; i < rec.num_windows; ++i) {
+        if(rec.windows[i] == window) return i;
+    }
+    VERIFY3U(rec.num_windows, <, REC_MAX_WINDOWS);
+    
+    rec.windows = safe_realloc(rec.windows, (rec.num_windows + 1) * sizeof(*rec.windows));
+    rec.windows[rec.num_windows] = window;
+    
+    rec_event_t def = {.type = REC_DEF, .window = rec.num_windows};
+    rec_id_t id = {};
+    lacf_strlcpy(id, window->conf.id, sizeof(id));
+    fwrite(&def, sizeof(def), 1, rec.file);
+    fwrite(id, sizeof(id), 1, rec.file);
+    
+    return rec.num_windows++;
+}
+
+static void rec_write(const window_t *window, rec_event_t *ev) {
+    ev->time = microclock() - rec.start;
+    ev->window = rec_window_index(window);
+    fwrite(ev, sizeof(*ev), 1, rec.file);
+}
+
+void rec_click(const window_t *window, int x, int y, XPLMMouseStatus status, int result, window_route_t route) {
+    if(!rec.file) return;
+    rec_event_t ev = {
+        .type = WINDOW_REC_CLICK,
+        .x = x,
+        .y = y,
+        .status = status,
+        .result = result,
+        .route = route
+    };
+    rec_write(window, &ev);
+}
+
+void rec_cursor(const window_t *window, int x, int y, XPLMCursorStatus result, window_route_t route) {
+    if(!rec.file) return;
+    rec_event_t ev = {.type = WINDOW_REC_CURSOR, .x = x, .y = y, .result = result, .route = route};
+    rec_write(window, &ev);
+}
+
+void rec_key(const window_t *window, char key, XPLMKeyFlags flags, char vkey, int lose, int result,
+             window_route_t route) {
+    if(!rec.file) return;
+    rec_event_t ev = {
+        .type = WINDOW_REC_KEY,
+        .status = flags,
+        .key = key,
+        .vkey = vkey,
+        .lose = lose,
+        .result = result,
+        .route = route
+    };
+    rec_write(window, &ev);
+}
+
+static void wait_until(uint64_t t) {
+    uint64_t now = microclock();
+    if(now >= t) return;
+#if IBM
+    Sleep((t - now) / 1000);
+#else
+    usleep(t - now);
+#endif
+}
+
+static int replay_event(window_t *window, const rec_event_t *ev, window_route_t *route) {
+    *route = WINDOW_ROUTE_NONE;
+    switch(ev->type) {
+    case WINDOW_REC_CLICK:
+        return window_route_click(window, ev->x, ev->y, ev->status, route);
+    case WINDOW_REC_CURSOR:
+        return window_route_cursor(window, ev->x, ev->y, route);
+    case WINDOW_REC_KEY:
+        return window_route_key(window, ev->key, ev->status, ev->vkey, ev->lose, route);
+    }
+    return 0;
+}
+
+bool window_replay(const char *path, bool realtime, window_replay_f cb, void *refcon,
+                   window_replay_stats_t *stats) {
+    ASSERT3P(path, !=, NULL);
+    
+    window_replay_stats_t st = {};
+    FILE *file = fopen(path, "rb");
+    if(!file) {
+        logMsg("could not open input recording `%s`", path);
+        return false;
+    }
+    
+    rec_header_t header;
+    if(fread(&header, sizeof(header), 1, file) != 1
+       || header.magic != REC_MAGIC || header.version != REC_VERSION) {
+        logMsg("`%s` is not a libwindow input recording", path);
+        fclose(file);
+        return false;
+    }
+    
+    window_t **windows = NULL;
+    rec_id_t *ids = NULL;
+    size_t num_windows = 0;
+    bool ok = true;
+    
+    uint64_t start = microclock();
+    double latency_total = 0;
+    rec_event_t ev;
+    
+    while(fread(&ev, sizeof(ev), 1, file) == 1) {
+        if(ev.type == REC_DEF) {
+            if(ev.window != num_windows) {
+                ok = false;
+                break;
+            }
+            windows = safe_realloc(windows, (num_windows + 1) * sizeof(*windows));
+            ids = safe_realloc(ids, (num_windows + 1) * sizeof(*ids));
+            if(fread(ids[num_windows], sizeof(*ids), 1, file) != 1) {
+                ok = false;
+                break;
+            }
+            ids[num_windows][sizeof(*ids) - 1] = '\0';
+            windows[num_windows] = window_find(ids[num_windows]);
+            num_windows += 1;
+            continue;
+        }
+        
+        if(ev.window >= num_windows) {
+            ok = false;
+            break;
+        }
+        
+        window_t *window = windows[ev.window];
+        if(!window) {
+            st.skipped += 1;
+            continue;
+        }
+        
+        if(realtime) wait_until(start + ev.time);
+        
+        uint64_t t0 = microclock();
+        window_route_t route;
+        int result = replay_event(window, &ev, &route);
+        double latency = microclock() - t0;
+        
+        st.events += 1;
+        if(result != ev.result || route != ev.route) st.mismatches += 1;
+        if(latency > st.latency_max) st.latency_max = latency;
+        latency_total += latency;
+        
+        if(cb) {
+            window_replay_event_t event = {
+                .type = ev.type,
+                .window_id = ids[ev.window],
+                .time = ev.time,
+                .latency = latency,
+                .expected = ev.result,
+                .result = result,
+                .expected_route = ev.route,
+                .route = route
+            };
+            cb(&event, refcon);
+        }
+    }
+    
+    if(!ok) logMsg("input recording `%s` is corrupt, replay stopped early", path);
+    if(st.events) st.latency_avg = latency_total / st.events;
+    if(stats) *stats = st;
+    
+    lacf_free(windows);
+    lacf_free(ids);
+    fclose(file);
+    return ok;
+}
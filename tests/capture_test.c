@@ -0,0 +1,464 @@
+/*===--------------------------------------------------------------------------------------------===
+ * capture_test.c
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2024 Amy Parent. All rights reserved
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+// Runs panel captures against a headless GL context: a source framebuffer stands in for the
+// sim's, is filled with a known pattern, captured with panel_cap_update(), and every capture
+// window is composited into its own target and checked pixel for pixel. Each case then times
+// the blit and the composite and reports their throughput. A last case checks that change
+// detection reports a single changed texel to every consumer.
+//
+// window.c isn't linked: window_new() below only keeps the draw callback, and draw_window()
+// calls it the way handle_draw() does, so only capture.c and what it uses run for real.
+#include <acfutils/glew.h>
+#include <acfutils/log.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/time.h>
+#include <window/capture.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include "../window_impl.h"
+#include "xplm_stub.h"
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+#define SKIP_CODE (77)
+#define BENCH_FRAMES (50)
+#define MARGIN (8)                  // Cleared border around each composited window
+#define MAX_WINDOWS (4)
+#define TOLERANCE (1)
+
+#define FBO_DR "sim/graphics/view/current_gl_fbo"
+#define PROJ_DR "sim/graphics/view/projection_matrix"
+#define MV_DR "sim/graphics/view/modelview_matrix"
+
+typedef struct {
+    vect2_t         pos;
+    vect2_t         size;
+    unsigned        layer;
+} test_window_t;
+
+typedef struct {
+    const char      *name;
+    vect2_t         size;
+    unsigned        num_buffers;
+    bool            client_source;      // Adds a second source, captured into layer 1
+    unsigned        num_windows;
+    test_window_t   windows[MAX_WINDOWS];
+} test_case_t;
+
+static const test_case_t cases[] = {
+    {"single", {256, 256}, 1, false, 1, {
+        {{0, 0}, {256, 256}, 0},
+    }},
+    {"quadrants", {1024, 768}, 2, false, 4, {
+        {{0, 0}, {512, 384}, 0},
+        {{512, 0}, {512, 384}, 0},
+        {{0, 384}, {512, 384}, 0},
+        {{512, 384}, {512, 384}, 0},
+    }},
+    {"odd", {1000, 600}, 1, true, 3, {
+        {{17, 33}, {300, 211}, 0},
+        {{640, 0}, {360, 600}, 0},
+        {{100, 101}, {257, 129}, 1},
+    }},
+    {"large", {2048, 2048}, 3, true, 3, {
+        {{0, 0}, {2048, 1024}, 0},
+        {{512, 1024}, {1024, 1024}, 0},
+        {{0, 0}, {2048, 2048}, 1},
+    }},
+};
+
+typedef struct {
+    GLuint          tex;
+    GLuint          fbo;
+    vect2_t         size;
+} target_t;
+
+static struct {
+    unsigned        failures;
+} test = {};
+
+// Stand-ins for the window.c functions capture.c calls
+
+window_t *window_new(const window_conf_t *conf, void *refcon) {
+    window_t *window = safe_calloc(1, sizeof(*window));
+    window->conf = *conf;
+    window->refcon = refcon;
+    return window;
+}
+
+void window_destroy(window_t *window) {
+    free(window);
+}
+
+bool window_is_visible(const window_t *window) {
+    UNUSED(window);
+    return true;
+}
+
+void window_get_gl_mem(const window_t *window, window_gl_mem_t *mem) {
+    UNUSED(window);
+    memset(mem, 0, sizeof(*mem));
+}
+
+void window_gl_mem_add(window_gl_mem_t *mem, const window_gl_mem_t *other) {
+    mem->textures += other->textures;
+    mem->framebuffers += other->framebuffers;
+    mem->programs += other->programs;
+    mem->caches += other->caches;
+    mem->texture_bytes += other->texture_bytes;
+    mem->cache_bytes += other->cache_bytes;
+}
+
+static void draw_window(window_t *window, vect2_t pos, vect2_t size) {
+    gls_pass_begin();
+    window->conf.draw(window, pos, size, window->refcon);
+    gls_invalidate();
+    gls_pass_end();
+}
+
+static void test_log(const char *str) {
+    fputs(str, stderr);
+}
+
+static bool gl_init(void) {
+    EGLDisplay display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if(display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) return false;
+    if(!eglBindAPI(EGL_OPENGL_API)) return false;
+    
+    const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint num_configs = 0;
+    if(!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) || num_configs < 1) return false;
+    
+    // The capture shaders are GLSL 1.20, so they need a compatibility profile.
+    const EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 2,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+    if(context == EGL_NO_CONTEXT) return false;
+    if(!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) return false;
+    
+    // GLEW also looks for a GLX display, which a surfaceless context doesn't have; the GL entry
+    // points are loaded by then.
+    GLenum err = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    if(err == GLEW_ERROR_NO_GLX_DISPLAY) err = GLEW_OK;
+#endif
+    if(err != GLEW_OK) return false;
+    
+    logMsg("GL: %s, %s", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+    return true;
+}
+
+// Every source and frame gets a different pattern, with neighbouring texels as far apart as
+// possible, so sampling the wrong texel, layer or buffer can't go unnoticed.
+static void pattern(unsigned seed, int x, int y, uint8_t px[4]) {
+    px[0] = (x * 7 + seed * 31) & 0xff;
+    px[1] = (y * 13 + seed * 17) & 0xff;
+    px[2] = (x ^ y ^ (seed * 59)) & 0xff;
+    px[3] = 0xff;
+}
+
+static void target_init(target_t *target, vect2_t size) {
+    target->size = size;
+    glGenTextures(1, &target->tex);
+    glBindTexture(GL_TEXTURE_2D, target->tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    
+    glGenFramebuffers(1, &target->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->tex, 0);
+    VERIFY3U(glCheckFramebufferStatus(GL_FRAMEBUFFER), ==, GL_FRAMEBUFFER_COMPLETE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+static void target_fini(target_t *target) {
+    glDeleteFramebuffers(1, &target->fbo);
+    glDeleteTextures(1, &target->tex);
+}
+
+static void target_fill(target_t *target, unsigned seed) {
+    int w = target->size.x, h = target->size.y;
+    uint8_t *pixels = safe_malloc((size_t)w * h * 4);
+    for(int y = 0; y < h; ++y) {
+        for(int x = 0; x < w; ++x) {
+            pattern(seed, x, y, &pixels[((size_t)y * w + x) * 4]);
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, target->tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    free(pixels);
+}
+
+// Sets the datarefs the sim would while drawing windows into `fbo`. They must exist before the
+// first panel is created, which looks them up.
+static void sim_set_view(GLuint fbo, vect2_t size) {
+    const float proj[16] = {
+        2 / size.x, 0, 0, 0,
+        0, 2 / size.y, 0, 0,
+        0, 0, -1, 0,
+        -1, -1, 0, 1
+    };
+    const float mv[16] = {
+        1, 0, 0, 0,
+        0, 1, 0, 0,
+        0, 0, 1, 0,
+        0, 0, 0, 1
+    };
+    xplm_stub_set_i(FBO_DR, fbo);
+    xplm_stub_set_vf(PROJ_DR, proj, 16);
+    xplm_stub_set_vf(MV_DR, mv, 16);
+}
+
+// Makes the target the sim's current framebuffer.
+static void target_bind(const target_t *target) {
+    sim_set_view(target->fbo, target->size);
+    glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+    glViewport(0, 0, target->size.x, target->size.y);
+}
+
+static void fail(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fputs("FAIL: ", stderr);
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    test.failures += 1;
+}
+
+static bool px_match(const uint8_t *a, const uint8_t *b) {
+    for(int i = 0; i < 4; ++i) {
+        if(abs((int)a[i] - (int)b[i]) > TOLERANCE) return false;
+    }
+    return true;
+}
+
+// Composites one capture window into a target with a cleared border around it, and compares
+// every pixel against the pattern its source was filled with.
+static void check_window(const test_case_t *tc, unsigned index, window_t *window, unsigned seed) {
+    const test_window_t *tw = &tc->windows[index];
+    target_t out;
+    target_init(&out, VECT2(tw->size.x + 2 * MARGIN, tw->size.y + 2 * MARGIN));
+    target_bind(&out);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    
+    draw_window(window, VECT2(MARGIN, MARGIN), tw->size);
+    
+    int w = out.size.x, h = out.size.y;
+    uint8_t *pixels = safe_malloc((size_t)w * h * 4);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, out.fbo);
+    glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    
+    static const uint8_t clear[4] = {0, 0, 0, 0};
+    unsigned seed_src = seed + tw->layer * 100;
+    unsigned mismatches = 0;
+    for(int y = 0; y < h; ++y) {
+        for(int x = 0; x < w; ++x) {
+            const uint8_t *px = &pixels[((size_t)y * w + x) * 4];
+            bool inside = x >= MARGIN && x < w - MARGIN && y >= MARGIN && y < h - MARGIN;
+            uint8_t expected[4];
+            if(inside) {
+                pattern(seed_src, (int)tw->pos.x + x - MARGIN, (int)tw->pos.y + y - MARGIN, expected);
+            } else {
+                memcpy(expected, clear, sizeof(expected));
+            }
+            if(px_match(px, expected)) continue;
+            if(!mismatches++) {
+                fail("%s: window %u at (%d, %d): got %02x%02x%02x%02x, expected %02x%02x%02x%02x",
+                     tc->name, index, x - MARGIN, y - MARGIN, px[0], px[1], px[2], px[3],
+                     expected[0], expected[1], expected[2], expected[3]);
+            }
+        }
+    }
+    if(mismatches > 1) fail("%s: window %u: %u pixels off", tc->name, index, mismatches);
+    
+    free(pixels);
+    target_fini(&out);
+}
+
+static double elapsed_s(uint64_t start) {
+    return (microclock() - start) / 1e6;
+}
+
+static void run_case(const test_case_t *tc) {
+    panel_cap_conf_t conf = {.size = tc->size, .num_buffers = tc->num_buffers};
+    panel_cap_t *cap = panel_cap_new2(&conf);
+    
+    target_t sim, client;
+    target_init(&sim, tc->size);
+    if(tc->client_source) {
+        target_init(&client, tc->size);
+        VERIFY3U(panel_cap_add_source(cap, client.fbo), ==, 1);
+    }
+    
+    window_t *windows[MAX_WINDOWS];
+    for(unsigned i = 0; i < tc->num_windows; ++i) {
+        const test_window_t *tw = &tc->windows[i];
+        char id[32];
+        snprintf(id, sizeof(id), "%s_%u", tc->name, i);
+        windows[i] = panel_cap_add_window2(cap, id, id, tw->pos, tw->size, tw->layer);
+    }
+    
+    // A new pattern each frame, so a window showing a stale buffer fails the check.
+    for(unsigned frame = 0; frame < 3; ++frame) {
+        target_fill(&sim, frame);
+        if(tc->client_source) target_fill(&client, frame + 100);
+        
+        target_bind(&sim);
+        panel_cap_update(cap);
+        glFinish();
+        // With several buffers, windows only switch to a finished blit at the next update.
+        if(tc->num_buffers > 1) {
+            panel_cap_update(cap);
+            glFinish();
+        }
+        
+        for(unsigned i = 0; i < tc->num_windows; ++i) {
+            check_window(tc, i, windows[i], frame);
+        }
+    }
+    if(glGetError() != GL_NO_ERROR) fail("%s: GL error", tc->name);
+    
+    target_t out;
+    target_init(&out, tc->size);
+    
+    // Every frame waits for the GPU, so no update is skipped for lack of a free buffer.
+    target_bind(&sim);
+    uint64_t start = microclock();
+    for(unsigned i = 0; i < BENCH_FRAMES; ++i) {
+        panel_cap_update(cap);
+        glFinish();
+    }
+    double blit_s = elapsed_s(start);
+    double blit_mpix = tc->size.x * tc->size.y * (tc->client_source ? 2 : 1) * BENCH_FRAMES / 1e6;
+    
+    target_bind(&out);
+    double composite_mpix = 0;
+    start = microclock();
+    for(unsigned i = 0; i < BENCH_FRAMES; ++i) {
+        for(unsigned j = 0; j < tc->num_windows; ++j) {
+            draw_window(windows[j], tc->windows[j].pos, tc->windows[j].size);
+            composite_mpix += tc->windows[j].size.x * tc->windows[j].size.y / 1e6;
+        }
+        glFinish();
+    }
+    double composite_s = elapsed_s(start);
+    
+    printf("%-10s %4.0fx%-4.0f %u buf  blit %8.1f MPix/s  composite %8.1f MPix/s\n",
+           tc->name, tc->size.x, tc->size.y, tc->num_buffers,
+           blit_mpix / blit_s, composite_mpix / composite_s);
+    
+    target_fini(&out);
+    panel_cap_destroy(cap);
+    if(tc->client_source) target_fini(&client);
+    target_fini(&sim);
+}
+
+// Captures `frames` frames of the sim target, waiting for each, so readbacks complete and get
+// collected by the next update.
+static void capture_frames(panel_cap_t *cap, const target_t *sim, unsigned frames) {
+    target_bind(sim);
+    for(unsigned i = 0; i < frames; ++i) {
+        panel_cap_update(cap);
+        glFinish();
+    }
+}
+
+static void check_changed(panel_cap_t *cap, const char *what, const window_t *window, uint64_t *seen,
+                          uint64_t expected) {
+    uint64_t mask = 0;
+    bool changed = panel_cap_window_changed(cap, window, seen, &mask);
+    if(changed != (expected != 0) || mask != expected) {
+        fail("change: %s: got %s, mask %016llx, expected mask %016llx", what,
+             changed ? "changed" : "unchanged", (unsigned long long)mask, (unsigned long long)expected);
+    }
+}
+
+// Two consumers keep their own cursors on the same window, and must both see a one texel change
+// of the lowest bit of one channel, in its tile only.
+static void run_change_case(void) {
+    const vect2_t size = VECT2(512, 256);
+    panel_cap_t *cap = panel_cap_new(size);
+    target_t sim;
+    target_init(&sim, size);
+    target_fill(&sim, 0);
+    
+    window_t *left = panel_cap_add_window(cap, "change_left", "change_left", VECT2(0, 0), VECT2(256, 256));
+    window_t *right = panel_cap_add_window(cap, "change_right", "change_right", VECT2(256, 0), VECT2(256, 256));
+    panel_cap_set_change_detect(cap, true);
+    capture_frames(cap, &sim, 3);
+    
+    // Everything counts as changed the first time each consumer asks, and only then.
+    uint64_t seen_a = 0, seen_b = 0, seen_right = 0;
+    check_changed(cap, "first look, a", left, &seen_a, ~0ull);
+    check_changed(cap, "first look, b", left, &seen_b, ~0ull);
+    check_changed(cap, "first look, right", right, &seen_right, ~0ull);
+    capture_frames(cap, &sim, 3);
+    check_changed(cap, "still, a", left, &seen_a, 0);
+    
+    // Tiles are 32 texels square, this is tile (3, 5) of the left window.
+    const int x = 3 * 32 + 3, y = 5 * 32 + 3;
+    uint8_t px[4];
+    pattern(0, x, y, px);
+    px[0] ^= 1;
+    glBindTexture(GL_TEXTURE_2D, sim.tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, px);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    capture_frames(cap, &sim, 3);
+    
+    const uint64_t tile = 1ull << (5 * 8 + 3);
+    check_changed(cap, "one texel, a", left, &seen_a, tile);
+    check_changed(cap, "one texel, a again", left, &seen_a, 0);
+    check_changed(cap, "one texel, b", left, &seen_b, tile);
+    check_changed(cap, "one texel, right", right, &seen_right, 0);
+    
+    if(glGetError() != GL_NO_ERROR) fail("change: GL error");
+    panel_cap_destroy(cap);
+    target_fini(&sim);
+}
+
+int main(void) {
+    log_init(test_log, "capture_test");
+    
+    if(!gl_init()) {
+        fprintf(stderr, "capture_test: no headless GL context, skipping\n");
+        return SKIP_CODE;
+    }
+    sim_set_view(0, VECT2(1, 1));
+    
+    for(size_t i = 0; i < ARRAY_NUM_ELEM(cases); ++i) {
+        run_case(&cases[i]);
+    }
+    run_change_case();
+    quad_sys_fini();
+    
+    if(test.failures) {
+        fprintf(stderr, "capture_test: %u failures\n", test.failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*===--------------------------------------------------------------------------------------------===
+ * coords_bench.c
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2024 Amy Parent. All rights reserved
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+// Times the batch coordinate conversions against a loop of the single-point ones, on a window
+// scaled to 1.5x its base size, and checks that both give the same results.
+//
+//      coords_bench [points] [rounds]
+#include <acfutils/cursor.h>
+#include <acfutils/log.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/time.h>
+#include <window/window.h>
+#include <XPLMDisplay.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "xplm_stub.h"
+
+#define DEFAULT_POINTS (4096)
+#define DEFAULT_ROUNDS (2000)
+#define EPSILON (1e-9)
+
+typedef void (*batch_f)(const window_t *window, const vect2_t *in, vect2_t *out, size_t n);
+typedef vect2_t (*point_f)(const window_t *window, vect2_t pos);
+
+typedef struct {
+    const char      *name;
+    batch_f         batch;
+    point_f         point;
+    bool            scaled;         // Whether the single-point result needs the content scale applied
+    bool            to_win;
+} bench_t;
+
+static const bench_t benches[] = {
+    {"desk2win", window_desk2win_v, window_desk2win, false, true},
+    {"win2desk", window_win2desk_v, window_win2desk, false, false},
+    {"desk2win_scaled", window_desk2win_scaled_v, window_desk2win, true, true},
+    {"win2desk_scaled", window_win2desk_scaled_v, window_win2desk, true, false},
+};
+
+// window_sys_init() insists on a cursor, which the sim would load. Defining these keeps
+// libacfutils' cursor code, and the windowing system it needs, out of the link.
+static int stub_cursor;
+
+cursor_t *cursor_read_from_file(const char *path) {
+    UNUSED(path);
+    return (cursor_t *)&stub_cursor;
+}
+
+void cursor_free(cursor_t *cursor) {
+    UNUSED(cursor);
+}
+
+void cursor_make_current(cursor_t *cursor) {
+    UNUSED(cursor);
+}
+
+static void bench_log(const char *str) {
+    fputs(str, stderr);
+}
+
+// The single-point conversions, the way a caller without the batch versions would convert an
+// array: one geometry query per point, with the content scale worked out once up front.
+static void scalar_loop(const bench_t *bench, const window_t *window, vect2_t scale,
+                        const vect2_t *in, vect2_t *out, size_t n) {
+    for(size_t i = 0; i < n; ++i) {
+        if(!bench->scaled) {
+            out[i] = bench->point(window, in[i]);
+        } else if(bench->to_win) {
+            vect2_t p = bench->point(window, in[i]);
+            out[i] = VECT2(p.x / scale.x, p.y / scale.y);
+        } else {
+            out[i] = bench->point(window, VECT2(in[i].x * scale.x, in[i].y * scale.y));
+        }
+    }
+}
+
+static double max_error(const vect2_t *a, const vect2_t *b, size_t n) {
+    double error = 0;
+    for(size_t i = 0; i < n; ++i) {
+        error = MAX(error, fabs(a[i].x - b[i].x));
+        error = MAX(error, fabs(a[i].y - b[i].y));
+    }
+    return error;
+}
+
+int main(int argc, const char **argv) {
+    size_t points = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_POINTS;
+    unsigned rounds = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_ROUNDS;
+    if(!points || !rounds) {
+        fprintf(stderr, "usage: %s [points] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    log_init(bench_log, "coords_bench");
+    xplm_stub_set_i("sim/graphics/VR/enabled", 0);
+    xplm_stub_set_i("sim/graphics/view/viewport", 0);
+    window_sys_init(".", ".");
+
+    window_conf_t conf = {
+        .size = VECT2(400, 300),
+        .min_scale = 0.5,
+        .max_scale = 4.0,
+        .name = "Bench",
+    };
+    window_t *window = window_new(&conf, NULL);
+    XPLMSetWindowGeometry(xplm_stub_last_window(), 130, 720, 730, 270);
+    vect2_t size = window_get_size(window);
+    vect2_t scale = VECT2(size.x / conf.size.x, size.y / conf.size.y);
+
+    vect2_t *in = safe_malloc(points * sizeof(*in));
+    vect2_t *scalar = safe_malloc(points * sizeof(*scalar));
+    vect2_t *batch = safe_malloc(points * sizeof(*batch));
+    for(size_t i = 0; i < points; ++i) {
+        in[i] = VECT2(130 + (i * 37) % 600 + 0.25, 270 + (i * 53) % 450 + 0.5);
+    }
+
+    int status = 0;
+    printf("%zu points, %u rounds\n", points, rounds);
+    for(size_t b = 0; b < ARRAY_NUM_ELEM(benches); ++b) {
+        const bench_t *bench = &benches[b];
+
+        uint64_t start = microclock();
+        for(unsigned r = 0; r < rounds; ++r) {
+            scalar_loop(bench, window, scale, in, scalar, points);
+        }
+        double scalar_ns = (microclock() - start) * 1e3 / ((double)rounds * points);
+
+        start = microclock();
+        for(unsigned r = 0; r < rounds; ++r) {
+            bench->batch(window, in, batch, points);
+        }
+        double batch_ns = (microclock() - start) * 1e3 / ((double)rounds * points);
+
+        double error = max_error(scalar, batch, points);
+        printf("%-16s scalar %7.3f ns/pt  batch %7.3f ns/pt  %5.1fx  max error %g\n",
+               bench->name, scalar_ns, batch_ns, scalar_ns / batch_ns, error);
+        if(error > EPSILON) status = 1;
+    }
+
+    free(in);
+    free(scalar);
+    free(batch);
+    window_destroy(window);
+    window_sys_fini();
+    return status;
+}
@@ -0,0 +1,207 @@
+/*===--------------------------------------------------------------------------------------------===
+ * record_test.c
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2024 Amy Parent. All rights reserved
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+// Records a sequence of input events delivered through a window's XPLM callbacks, replays it, and
+// checks that every event takes the same route as it did when recorded. A second replay, with the
+// window's click callback changed, must report the events whose route changed.
+#include <acfutils/cursor.h>
+#include <acfutils/log.h>
+#include <window/record.h>
+#include <window/window.h>
+#include <XPLMDisplay.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include "xplm_stub.h"
+
+#define REC_PATH "record_test.rec"
+
+typedef enum {
+    EV_CLICK,
+    EV_CURSOR,
+    EV_KEY,
+} ev_type_t;
+
+typedef struct {
+    ev_type_t       type;
+    int             x, y;           // Key events carry the key in x
+    int             status;         // Mouse status, or key flags
+    int             lose;
+    window_route_t  route;          // Route the event must take
+} test_event_t;
+
+// The window starts at (100, 100)-(500, 400). Its close button is in the top left corner, its
+// pop-out button in the top right one, and the click callback only consumes the left half.
+static const test_event_t events[] = {
+    {EV_CURSOR, 110, 390, 0, 0, WINDOW_ROUTE_CLOSE},
+    {EV_CURSOR, 300, 250, 0, 0, WINDOW_ROUTE_NONE},
+    {EV_CURSOR, 490, 390, 0, 0, WINDOW_ROUTE_POPOUT},
+    {EV_CLICK, 200, 250, xplm_MouseDown, 0, WINDOW_ROUTE_CALLBACK},
+    {EV_CLICK, 210, 250, xplm_MouseDrag, 0, WINDOW_ROUTE_CALLBACK},
+    {EV_CLICK, 210, 250, xplm_MouseUp, 0, WINDOW_ROUTE_CALLBACK_PASSED},
+    {EV_CLICK, 400, 250, xplm_MouseDown, 0, WINDOW_ROUTE_DRAG_START},
+    {EV_CLICK, 410, 260, xplm_MouseDrag, 0, WINDOW_ROUTE_DRAG},
+    {EV_CLICK, 410, 260, xplm_MouseUp, 0, WINDOW_ROUTE_DRAG_END},
+    {EV_KEY, 'a', 0, xplm_DownFlag, 0, WINDOW_ROUTE_CALLBACK},
+    {EV_KEY, 'a', 0, xplm_UpFlag, 0, WINDOW_ROUTE_NONE},
+    {EV_KEY, 0, 0, 0, 1, WINDOW_ROUTE_FOCUS_LOST},
+    {EV_CLICK, 115, 400, xplm_MouseDown, 0, WINDOW_ROUTE_CLOSE},    // Dragged by (10, 10)
+};
+
+static struct {
+    unsigned        failures;
+    bool            decline;        // Whether the click callback consumes nothing
+    unsigned        replayed;
+    unsigned        result_changed; // Replayed events whose result changed
+} test = {};
+
+// window_sys_init() insists on a cursor, which the sim would load. Defining these keeps
+// libacfutils' cursor code, and the windowing system it needs, out of the link.
+static int stub_cursor;
+
+cursor_t *cursor_read_from_file(const char *path) {
+    UNUSED(path);
+    return (cursor_t *)&stub_cursor;
+}
+
+void cursor_free(cursor_t *cursor) {
+    UNUSED(cursor);
+}
+
+void cursor_make_current(cursor_t *cursor) {
+    UNUSED(cursor);
+}
+
+static void test_log(const char *str) {
+    fputs(str, stderr);
+}
+
+static void fail(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fputs("FAIL: ", stderr);
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    test.failures += 1;
+}
+
+static int on_click(window_t *window, mouse_action_t act, vect2_t pos, vect2_t scale, void *refcon) {
+    UNUSED(window);
+    UNUSED(act);
+    UNUSED(scale);
+    UNUSED(refcon);
+    return !test.decline && pos.x < 200;
+}
+
+static void on_key(window_t *window, int key, char c, bool ctrl, void *refcon) {
+    UNUSED(window);
+    UNUSED(c);
+    UNUSED(key);
+    UNUSED(ctrl);
+    UNUSED(refcon);
+}
+
+static void deliver(void *id, const test_event_t *ev) {
+    switch(ev->type) {
+    case EV_CLICK:
+        xplm_stub_click(id, ev->x, ev->y, ev->status);
+        break;
+    case EV_CURSOR:
+        xplm_stub_cursor(id, ev->x, ev->y);
+        break;
+    case EV_KEY:
+        xplm_stub_key(id, ev->x, ev->status, ev->x, ev->lose);
+        break;
+    }
+}
+
+// Puts the window back where the recording started.
+static void reset_window(window_t *window, void *id) {
+    XPLMSetWindowGeometry(id, 100, 400, 500, 100);
+    window_show(window);
+}
+
+static void check_event(const window_replay_event_t *event, void *refcon) {
+    UNUSED(refcon);
+    unsigned i = test.replayed++;
+    if(i >= ARRAY_NUM_ELEM(events)) return;
+    if(event->result != event->expected) test.result_changed += 1;
+    
+    if(event->expected_route != events[i].route) {
+        fail("event %u: recorded route %d, expected %d", i, event->expected_route, events[i].route);
+    }
+    if(!test.decline && event->route != events[i].route) {
+        fail("event %u: replayed route %d, expected %d", i, event->route, events[i].route);
+    }
+    
+    // Declining clicks turns the first mouse down into the start of a drag. XPLM gets the same
+    // result either way, only the route tells them apart. The events after it go their own way.
+    if(test.decline && i == 3 && (event->result != event->expected || event->route != WINDOW_ROUTE_DRAG_START)) {
+        fail("event %u: declined click gave result %d, route %d", i, event->result, event->route);
+    }
+}
+
+static void replay(window_t *window, void *id, bool decline) {
+    reset_window(window, id);
+    test.decline = decline;
+    test.replayed = 0;
+    test.result_changed = 0;
+    
+    window_replay_stats_t stats;
+    if(!window_replay(REC_PATH, false, check_event, NULL, &stats)) fail("replay failed");
+    if(stats.events != ARRAY_NUM_ELEM(events) || test.replayed != stats.events) {
+        fail("replayed %u events, expected %zu", stats.events, ARRAY_NUM_ELEM(events));
+    }
+    // Events whose route changed but whose result didn't must count as mismatches too.
+    if(decline ? stats.mismatches <= test.result_changed : stats.mismatches) {
+        fail("replay with decline=%d: %u mismatches, %u with a different result", decline,
+             stats.mismatches, test.result_changed);
+    }
+}
+
+int main(void) {
+    log_init(test_log, "record_test");
+    xplm_stub_set_i("sim/graphics/VR/enabled", 0);
+    xplm_stub_set_i("sim/graphics/view/viewport", 0);
+    window_sys_init(".", ".");
+    
+    window_conf_t conf = {
+        .size = VECT2(400, 300),
+        .min_scale = 0.5,
+        .max_scale = 4.0,
+        .name = "Record",
+        .click = on_click,
+        .key = on_key,
+    };
+    window_t *window = window_new(&conf, NULL);
+    void *id = xplm_stub_last_window();
+    reset_window(window, id);
+    
+    if(!window_rec_start(REC_PATH)) {
+        fprintf(stderr, "record_test: could not record to %s\n", REC_PATH);
+        return 1;
+    }
+    for(size_t i = 0; i < ARRAY_NUM_ELEM(events); ++i) {
+        deliver(id, &events[i]);
+    }
+    window_rec_stop();
+    
+    replay(window, id, false);
+    replay(window, id, true);
+    
+    remove(REC_PATH);
+    window_destroy(window);
+    window_sys_fini();
+    
+    if(test.failures) {
+        fprintf(stderr, "record_test: %u failures\n", test.failures);
+        return 1;
+    }
+    return 0;
+}
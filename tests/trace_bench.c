@@ -0,0 +1,74 @@
+/*===--------------------------------------------------------------------------------------------===
+ * trace_bench.c
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2024 Amy Parent. All rights reserved
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+// Times the tracing hooks, with no trace running and while recording one. Events are recorded in
+// batches that fit in a thread's buffer, with a flush between batches that isn't timed, so no
+// event is dropped and only the cost on the traced thread is measured.
+//
+//      trace_bench [rounds]
+#include <acfutils/log.h>
+#include <acfutils/time.h>
+#include <window/trace.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../trace_impl.h"
+
+#define DEFAULT_ROUNDS (200)
+#define BATCH (4096)                // begin/end pairs, half of a thread's buffer
+#define BUDGET_NS (100.0)           // Per event, while tracing
+
+static void bench_log(const char *str) {
+    fputs(str, stderr);
+}
+
+// Hooks the way libwindow's own code calls them. `noinline` keeps the compiler from hoisting the
+// trace_on check out of the loop, which it can't do around real callbacks either.
+__attribute__((noinline)) static void traced_call(void) {
+    trace_begin("bench");
+    trace_end("bench");
+}
+
+static double time_batches(unsigned rounds, bool flush) {
+    uint64_t total = 0;
+    for(unsigned r = 0; r < rounds; ++r) {
+        uint64_t start = microclock();
+        for(unsigned i = 0; i < BATCH; ++i) {
+            traced_call();
+        }
+        total += microclock() - start;
+        if(flush) window_trace_flush();
+    }
+    return total * 1e3 / ((double)rounds * BATCH * 2);
+}
+
+int main(int argc, const char **argv) {
+    unsigned rounds = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_ROUNDS;
+    if(!rounds) {
+        fprintf(stderr, "usage: %s [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    log_init(bench_log, "trace_bench");
+    trace_sys_init(".");
+
+    double off_ns = time_batches(rounds, false);
+
+    if(!window_trace_start(0)) return 1;
+    time_batches(1, true);          // Registers this thread's buffer outside of the timings
+    double on_ns = time_batches(rounds, true);
+    window_trace_stop();
+    trace_sys_fini();
+    remove("libwindow-trace.json");
+
+    printf("%u x %u events\n", rounds, BATCH * 2);
+    printf("tracing off %7.3f ns/event\n", off_ns);
+    printf("tracing on  %7.3f ns/event  (budget %.0f ns)%s\n", on_ns, BUDGET_NS,
+           on_ns > BUDGET_NS ? "  OVER BUDGET" : "");
+    return 0;
+}
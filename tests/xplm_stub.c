@@ -0,0 +1,290 @@
+/*===--------------------------------------------------------------------------------------------===
+ * xplm_stub.c
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2024 Amy Parent. All rights reserved
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+#include "xplm_stub.h"
+#include <acfutils/assert.h>
+#include <acfutils/glew.h>
+#include <acfutils/helpers.h>
+#include <acfutils/safe_alloc.h>
+#include <XPLMDataAccess.h>
+#include <XPLMDisplay.h>
+#include <XPLMGraphics.h>
+#include <XPLMProcessing.h>
+#include <XPLMUtilities.h>
+#include <stdio.h>
+
+#define MAX_DATAREFS (16)
+#define MAX_VALUES (16)
+
+typedef struct {
+    char            name[128];
+    XPLMDataTypeID  type;
+    int             i;
+    float           vf[MAX_VALUES];
+    int             count;
+} stub_dr_t;
+
+typedef struct {
+    int             left, top, right, bottom;
+    int             visible;
+    XPLMCreateWindow_t params;      // Callbacks and refcon
+} stub_window_t;
+
+static struct {
+    stub_dr_t       dr[MAX_DATAREFS];
+    unsigned        num_dr;
+    stub_window_t   *last_window;
+    stub_window_t   *focus;
+} stub = {};
+
+static stub_dr_t *stub_dr_get(const char *name) {
+    for(unsigned i = 0; i < stub.num_dr; ++i) {
+        if(!strcmp(stub.dr[i].name, name)) return &stub.dr[i];
+    }
+    VERIFY3U(stub.num_dr, <, MAX_DATAREFS);
+    stub_dr_t *dr = &stub.dr[stub.num_dr++];
+    lacf_strlcpy(dr->name, name, sizeof(dr->name));
+    return dr;
+}
+
+void xplm_stub_set_i(const char *name, int value) {
+    stub_dr_t *dr = stub_dr_get(name);
+    dr->type = xplmType_Int;
+    dr->i = value;
+}
+
+void xplm_stub_set_vf(const char *name, const float *values, int count) {
+    VERIFY3S(count, <=, MAX_VALUES);
+    stub_dr_t *dr = stub_dr_get(name);
+    dr->type = xplmType_FloatArray;
+    memcpy(dr->vf, values, count * sizeof(float));
+    dr->count = count;
+}
+
+void *xplm_stub_last_window(void) {
+    return stub.last_window;
+}
+
+int xplm_stub_click(void *id, int x, int y, XPLMMouseStatus status) {
+    stub_window_t *window = id;
+    return window->params.handleMouseClickFunc(id, x, y, status, window->params.refcon);
+}
+
+XPLMCursorStatus xplm_stub_cursor(void *id, int x, int y) {
+    stub_window_t *window = id;
+    return window->params.handleCursorFunc(id, x, y, window->params.refcon);
+}
+
+void xplm_stub_key(void *id, char key, XPLMKeyFlags flags, char vkey, int lose) {
+    stub_window_t *window = id;
+    window->params.handleKeyFunc(id, key, flags, vkey, window->params.refcon, lose);
+}
+
+// Data access
+
+XPLMDataRef XPLMFindDataRef(const char *name) {
+    for(unsigned i = 0; i < stub.num_dr; ++i) {
+        if(!strcmp(stub.dr[i].name, name)) return &stub.dr[i];
+    }
+    return NULL;
+}
+
+int XPLMCanWriteDataRef(XPLMDataRef ref) {
+    UNUSED(ref);
+    return 0;
+}
+
+int XPLMIsDataRefGood(XPLMDataRef ref) {
+    return ref != NULL;
+}
+
+XPLMDataTypeID XPLMGetDataRefTypes(XPLMDataRef ref) {
+    return ((const stub_dr_t *)ref)->type;
+}
+
+int XPLMGetDatai(XPLMDataRef ref) {
+    return ((const stub_dr_t *)ref)->i;
+}
+
+float XPLMGetDataf(XPLMDataRef ref) {
+    return ((const stub_dr_t *)ref)->i;
+}
+
+double XPLMGetDatad(XPLMDataRef ref) {
+    return ((const stub_dr_t *)ref)->i;
+}
+
+int XPLMGetDatavf(XPLMDataRef ref, float *values, int offset, int max) {
+    const stub_dr_t *dr = ref;
+    if(!values) return dr->count;
+    int count = MAX(0, MIN(max, dr->count - offset));
+    memcpy(values, dr->vf + offset, count * sizeof(float));
+    return count;
+}
+
+// Graphics, reduced to the GL state the sim's calls would leave behind
+
+void XPLMSetGraphicsState(int fog, int tex_units, int lighting, int alpha_test, int alpha_blend,
+                          int depth_test, int depth_write) {
+    UNUSED(fog);
+    UNUSED(tex_units);
+    UNUSED(lighting);
+    UNUSED(alpha_test);
+    
+    if(alpha_blend) {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    } else {
+        glDisable(GL_BLEND);
+    }
+    if(depth_test) glEnable(GL_DEPTH_TEST);
+    else glDisable(GL_DEPTH_TEST);
+    glDepthMask(depth_write ? GL_TRUE : GL_FALSE);
+}
+
+void XPLMBindTexture2d(int tex, int unit) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, tex);
+}
+
+void XPLMGenerateTextureNumbers(int *ids, int count) {
+    glGenTextures(count, (GLuint *)ids);
+}
+
+// Windows
+
+XPLMWindowID XPLMCreateWindowEx(XPLMCreateWindow_t *params) {
+    stub_window_t *window = safe_calloc(1, sizeof(*window));
+    window->left = params->left;
+    window->top = params->top;
+    window->right = params->right;
+    window->bottom = params->bottom;
+    window->visible = params->visible;
+    window->params = *params;
+    stub.last_window = window;
+    return window;
+}
+
+void XPLMDestroyWindow(XPLMWindowID id) {
+    if(stub.last_window == id) stub.last_window = NULL;
+    if(stub.focus == id) stub.focus = NULL;
+    free(id);
+}
+
+void XPLMGetScreenSize(int *width, int *height) {
+    if(width) *width = 1920;
+    if(height) *height = 1080;
+}
+
+void XPLMGetWindowGeometry(XPLMWindowID id, int *left, int *top, int *right, int *bottom) {
+    const stub_window_t *window = id;
+    if(left) *left = window->left;
+    if(top) *top = window->top;
+    if(right) *right = window->right;
+    if(bottom) *bottom = window->bottom;
+}
+
+void XPLMSetWindowGeometry(XPLMWindowID id, int left, int top, int right, int bottom) {
+    stub_window_t *window = id;
+    window->left = left;
+    window->top = top;
+    window->right = right;
+    window->bottom = bottom;
+}
+
+int XPLMGetWindowIsVisible(XPLMWindowID id) {
+    return ((const stub_window_t *)id)->visible;
+}
+
+void XPLMSetWindowIsVisible(XPLMWindowID id, int visible) {
+    ((stub_window_t *)id)->visible = visible;
+}
+
+// Every window is in front: nothing here stacks them.
+int XPLMIsWindowInFront(XPLMWindowID id) {
+    UNUSED(id);
+    return 1;
+}
+
+int XPLMHasKeyboardFocus(XPLMWindowID id) {
+    return stub.focus == id;
+}
+
+void XPLMTakeKeyboardFocus(XPLMWindowID id) {
+    stub.focus = id;
+}
+
+int XPLMWindowIsPoppedOut(XPLMWindowID id) {
+    UNUSED(id);
+    return 0;
+}
+
+int XPLMWindowIsInVR(XPLMWindowID id) {
+    UNUSED(id);
+    return 0;
+}
+
+void XPLMSetWindowPositioningMode(XPLMWindowID id, XPLMWindowPositioningMode mode, int monitor) {
+    UNUSED(id);
+    UNUSED(mode);
+    UNUSED(monitor);
+}
+
+void XPLMSetWindowTitle(XPLMWindowID id, const char *title) {
+    UNUSED(id);
+    UNUSED(title);
+}
+
+void XPLMSetWindowResizingLimits(XPLMWindowID id, int min_width, int min_height, int max_width,
+                                 int max_height) {
+    UNUSED(id);
+    UNUSED(min_width);
+    UNUSED(min_height);
+    UNUSED(max_width);
+    UNUSED(max_height);
+}
+
+// Flight loops never run, since nothing drives the sim's frames
+
+XPLMFlightLoopID XPLMCreateFlightLoop(XPLMCreateFlightLoop_t *params) {
+    UNUSED(params);
+    return safe_calloc(1, 1);
+}
+
+void XPLMDestroyFlightLoop(XPLMFlightLoopID id) {
+    free(id);
+}
+
+void XPLMScheduleFlightLoop(XPLMFlightLoopID id, float interval, int relative) {
+    UNUSED(id);
+    UNUSED(interval);
+    UNUSED(relative);
+}
+
+// Utilities
+
+void XPLMDebugString(const char *str) {
+    fputs(str, stderr);
+}
+
+void XPLMRegisterCommandHandler(XPLMCommandRef cmd, XPLMCommandCallback_f handler, int before,
+                                void *refcon) {
+    UNUSED(cmd);
+    UNUSED(handler);
+    UNUSED(before);
+    UNUSED(refcon);
+}
+
+void XPLMUnregisterCommandHandler(XPLMCommandRef cmd, XPLMCommandCallback_f handler, int before,
+                                  void *refcon) {
+    UNUSED(cmd);
+    UNUSED(handler);
+    UNUSED(before);
+    UNUSED(refcon);
+}
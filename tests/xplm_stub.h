@@ -0,0 +1,30 @@
+/*===--------------------------------------------------------------------------------------------===
+ * xplm_stub.h
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2024 Amy Parent
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+#ifndef _XPLM_STUB_H_
+#define _XPLM_STUB_H_
+
+#include <XPLMDisplay.h>
+
+// Just enough of XPLM to run libwindow outside of the sim. Datarefs only exist once a test has
+// given them a value, and windows are plain rectangles that never draw, and only receive the
+// input a test delivers. Anything not implemented here is left unresolved at link time, so calling it crashes.
+
+void xplm_stub_set_i(const char *name, int value);
+void xplm_stub_set_vf(const char *name, const float *values, int count);
+
+// The window most recently created through XPLMCreateWindowEx(), or NULL.
+void *xplm_stub_last_window(void);
+
+// Deliver input to a window's XPLM callbacks, the way the sim would.
+int xplm_stub_click(void *window, int x, int y, XPLMMouseStatus status);
+XPLMCursorStatus xplm_stub_cursor(void *window, int x, int y);
+void xplm_stub_key(void *window, char key, XPLMKeyFlags flags, char vkey, int lose);
+
+#endif /* ifndef _XPLM_STUB_H_ */
@@ -0,0 +1,260 @@
+/*===--------------------------------------------------------------------------------------------===
+ * trace.c
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2024 Amy Parent. All rights reserved
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+#include "trace_impl.h"
+#include <window/trace.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/helpers.h>
+#include <acfutils/list.h>
+#include <acfutils/log.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/thread.h>
+#include <XPLMProcessing.h>
+#include <stdio.h>
+
+#if IBM
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define TRACE_FILE "libwindow-trace.json"
+#define TRACE_BUF_SIZE (1 << 14)    // Events per thread, must be a power of two
+
+typedef struct {
+    const char      *name;
+    uint64_t        time;           // Nanoseconds since trace_sys_init()
+    char            phase;
+} trace_event_t;
+
+// Single-producer, single-consumer ring. Only the owning thread moves `head`, and only the
+// flush moves `tail`, so neither side needs a lock.
+typedef struct {
+    unsigned        tid;
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    _Atomic uint32_t dropped;
+    trace_event_t   events[TRACE_BUF_SIZE];
+    
+    list_node_t     node;
+} trace_buf_t;
+
+atomic_bool trace_on = false;
+
+static struct {
+    bool            is_init;
+    char            *output_dir;
+    uint64_t        start;
+#if IBM
+    uint64_t        freq;
+#endif
+    
+    mutex_t         lock;           // Protects the list of buffers
+    list_t          bufs;
+    unsigned        next_tid;
+    _Atomic unsigned gen;           // Bumped on every init, so stale thread buffers are dropped
+    
+    FILE            *file;
+    uint64_t        dropped;
+    XPLMFlightLoopID loop;
+    float           interval;
+} trace = {};
+
+static _Thread_local trace_buf_t *local_buf = NULL;
+static _Thread_local unsigned local_gen = 0;
+
+static uint64_t trace_now(void) {
+#if IBM
+    LARGE_INTEGER count;
+    QueryPerformanceCounter(&count);
+    return (uint64_t)((double)count.QuadPart * 1e9 / trace.freq);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+static trace_buf_t *trace_register(void) {
+    trace_buf_t *buf = safe_calloc(1, sizeof(*buf));
+    
+    mutex_enter(&trace.lock);
+    if(!trace.is_init) {
+        mutex_exit(&trace.lock);
+        lacf_free(buf);
+        return NULL;
+    }
+    buf->tid = ++trace.next_tid;
+    list_insert_tail(&trace.bufs, buf);
+    local_gen = atomic_load(&trace.gen);
+    mutex_exit(&trace.lock);
+    
+    local_buf = buf;
+    return buf;
+}
+
+void trace_event(const char *name, char phase) {
+    trace_buf_t *buf = local_buf;
+    if(!buf || local_gen != atomic_load_explicit(&trace.gen, memory_order_relaxed)) {
+        buf = trace_register();
+        if(!buf) return;
+    }
+    
+    uint32_t head = atomic_load_explicit(&buf->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&buf->tail, memory_order_acquire);
+    if(head - tail >= TRACE_BUF_SIZE) {
+        atomic_fetch_add_explicit(&buf->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    
+    trace_event_t *ev = &buf->events[head & (TRACE_BUF_SIZE - 1)];
+    ev->name = name;
+    ev->phase = phase;
+    ev->time = trace_now() - trace.start;
+    atomic_store_explicit(&buf->head, head + 1, memory_order_release);
+}
+
+static float trace_loop_cb(float elapsed, float since_last, int counter, void *refcon) {
+    UNUSED(elapsed);
+    UNUSED(since_last);
+    UNUSED(counter);
+    UNUSED(refcon);
+    
+    window_trace_flush();
+    return trace.interval;
+}
+
+void trace_sys_init(const char *output_dir) {
+    if(trace.is_init) return;
+    
+    mutex_init(&trace.lock);
+    list_create(&trace.bufs, sizeof(trace_buf_t), offsetof(trace_buf_t, node));
+    trace.output_dir = safe_strdup(output_dir);
+    trace.next_tid = 0;
+#if IBM
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    trace.freq = freq.QuadPart;
+#endif
+    trace.start = trace_now();
+    atomic_fetch_add(&trace.gen, 1);
+    trace.is_init = true;
+}
+
+void trace_sys_fini(void) {
+    if(!trace.is_init) return;
+    window_trace_stop();
+    
+    mutex_enter(&trace.lock);
+    trace.is_init = false;
+    trace_buf_t *buf = NULL;
+    while((buf = list_remove_head(&trace.bufs)) != NULL) {
+        lacf_free(buf);
+    }
+    mutex_exit(&trace.lock);
+    
+    list_destroy(&trace.bufs);
+    mutex_destroy(&trace.lock);
+    lacf_free(trace.output_dir);
+    trace.output_dir = NULL;
+}
+
+bool window_trace_start(double flush_interval) {
+    VERIFY(trace.is_init);
+    if(trace.file) window_trace_stop();
+    
+    char *path = mkpathname(trace.output_dir, TRACE_FILE, NULL);
+    trace.file = fopen(path, "w");
+    if(!trace.file) {
+        logMsg("could not open trace file `%s`", path);
+        lacf_free(path);
+        return false;
+    }
+    lacf_free(path);
+    
+    // Anything left over from a previous trace is stale.
+    mutex_enter(&trace.lock);
+    for(trace_buf_t *buf = list_head(&trace.bufs); buf; buf = list_next(&trace.bufs, buf)) {
+        atomic_store(&buf->tail, atomic_load(&buf->head));
+        atomic_store(&buf->dropped, 0);
+    }
+    mutex_exit(&trace.lock);
+    trace.dropped = 0;
+    
+    fprintf(trace.file, "[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"libwindow\"}}");
+    
+    if(flush_interval > 0) {
+        XPLMCreateFlightLoop_t loop = {
+            .structSize = sizeof(loop),
+            .phase = xplm_FlightLoop_Phase_AfterFlightModel,
+            .callbackFunc = trace_loop_cb,
+            .refcon = NULL
+        };
+        trace.interval = flush_interval;
+        trace.loop = XPLMCreateFlightLoop(&loop);
+        XPLMScheduleFlightLoop(trace.loop, trace.interval, 1);
+    }
+    
+    atomic_store(&trace_on, true);
+    return true;
+}
+
+void window_trace_stop(void) {
+    if(!trace.file) return;
+    atomic_store(&trace_on, false);
+    
+    if(trace.loop) XPLMDestroyFlightLoop(trace.loop);
+    trace.loop = NULL;
+    
+    window_trace_flush();
+    fprintf(trace.file, "\n]\n");
+    fclose(trace.file);
+    trace.file = NULL;
+    
+    if(trace.dropped) {
+        logMsg("trace buffers overflowed, %llu events were dropped", (unsigned long long)trace.dropped);
+    }
+}
+
+bool window_trace_flush(void) {
+    if(!trace.file) return false;
+    
+    mutex_enter(&trace.lock);
+    for(trace_buf_t *buf = list_head(&trace.bufs); buf; buf = list_next(&trace.bufs, buf)) {
+        uint32_t tail = atomic_load_explicit(&buf->tail, memory_order_relaxed);
+        uint32_t head = atomic_load_explicit(&buf->head, memory_order_acquire);
+        
+        for(; tail != head; ++tail) {
+            const trace_event_t *ev = &buf->events[tail & (TRACE_BUF_SIZE - 1)];
+            fprintf(trace.file, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+                    ev->name, ev->phase, ev->time / 1e3, buf->tid);
+        }
+        atomic_store_explicit(&buf->tail, tail, memory_order_release);
+        trace.dropped += atomic_exchange_explicit(&buf->dropped, 0, memory_order_relaxed);
+    }
+    mutex_exit(&trace.lock);
+    
+    fflush(trace.file);
+    return true;
+}
+
+bool window_trace_is_active(void) {
+    return trace.file != NULL;
+}
+
+void window_trace_begin(const char *name) {
+    ASSERT3P(name, !=, NULL);
+    trace_begin(name);
+}
+
+void window_trace_end(const char *name) {
+    ASSERT3P(name, !=, NULL);
+    trace_end(name);
+}
@@ -0,0 +1,34 @@
+/*===--------------------------------------------------------------------------------------------===
+ * trace_impl.h
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2024 Amy Parent
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+#ifndef _TRACE_IMPL_H_
+#define _TRACE_IMPL_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Timeline tracing hooks. Event names are stored by pointer and only read at flush time, so they
+// must be string literals. When no trace is running, a hook costs one relaxed load.
+
+extern atomic_bool trace_on;
+
+void trace_event(const char *name, char phase);
+
+static inline void trace_begin(const char *name) {
+    if(atomic_load_explicit(&trace_on, memory_order_relaxed)) trace_event(name, 'B');
+}
+
+static inline void trace_end(const char *name) {
+    if(atomic_load_explicit(&trace_on, memory_order_relaxed)) trace_event(name, 'E');
+}
+
+void trace_sys_init(const char *output_dir);
+void trace_sys_fini(void);
+
+#endif /* ifndef _TRACE_IMPL_H_ */
@@ -7,20 +7,28 @@
  * Licensed under the MIT License
  *===--------------------------------------------------------------------------------------------===
 */
-#include <window/window.h>
+#include "window_impl.h"
+#include <window/image.h>
 
 #include <acfutils/assert.h>
-#include <acfutils/avl.h>
 #include <acfutils/safe_alloc.h>
 #include <acfutils/glew.h>
 #include <acfutils/dr.h>
-#include <acfutils/lacf_gl_pic.h>
 #include <acfutils/conf.h>
 #include <acfutils/time.h>
 #include <acfutils/cursor.h>
-#include <acfutils/widget.h>
+#include <acfutils/htbl.h>
+#include <ctype.h>
 #include <stddef.h>
+#include <sys/stat.h>
 #include <XPLMGraphics.h>
+#include <XPLMProcessing.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 #define BUTTON_ASSET_SIZE (64)
 #define BUTTON_SIZE (BUTTON_ASSET_SIZE/2.0)
@@ -28,128 +36,507 @@
 #define KEYBOARD_WIDTH (50)
 #define KEYBOARD_HEIGHT BUTTON_SIZE
 #define RESIZE_MARGIN (12)
+#define POOL_CHUNK_SIZE (16)
+#define LAYOUT_BUCKETS (64)
+#define ID_BUCKETS (64)
+
+enum {
+    LAYOUT_MODE     = 1 << 0,
+    LAYOUT_GEOM     = 1 << 1,
+    LAYOUT_VISIBLE  = 1 << 2,
+};
+
+// A window's pending layout change. Only the last value of each field is kept, which is all the
+// sim would have ended up with had the calls been made right away.
+typedef struct {
+    unsigned                    mask;
+    XPLMWindowPositioningMode   mode;
+    int                         monitor;
+    bool                        geom_os;
+    int                         left, top, right, bottom;
+    bool                        visible;
+} layout_change_t;
+
+typedef char layout_key_t[sizeof(((window_conf_t *)NULL)->id)];
 
-struct window_t {
-    XPLMWindowID        ref;
-    XPLMCommandRef      cmd;
+// A window's saved layout, as last read from or written to windows.txt. Entries are kept for
+// every id in the file, including windows that haven't been created yet, and are looked up by
+// their zero-padded id.
+typedef struct {
+    layout_key_t                id;
+    int                         left, top, right, bottom;
+    bool                        visible;
+    bool                        popout;
     
-    bool                is_decorated;
-    win_resize_ctl_t    resize_ctl;
-    vect2_t             last_click;
-    double              last_hover;
+    list_node_t                 node;
+} layout_entry_t;
+
+typedef struct {
+    uint64_t                    period;     // Microseconds between redraws, 0 if unscheduled
+    int                         priority;
+    int                         planned;    // Last frame the window was scheduled to redraw in
+    uint64_t                    last_draw;
     
-    window_conf_t       conf;
-    avl_node_t          mgr_node;
-    void                *refcon;
-};
+    double                      draw_time;
+    unsigned                    starved;
+    unsigned                    starved_max;
+    unsigned long long          skipped;
+    unsigned long long          drawn;
+} sched_t;
+
+// Windows are allocated from a pool of fixed-size chunks, so window_t pointers handed out to
+// clients never move, and a window's handle doubles as its index in the pool. The hot state
+// is kept out of window_t, in arrays indexed by handle, so that whole-system passes are linear
+// scans over contiguous memory.
+typedef struct {
+    window_t        **chunks;
+    size_t          num_chunks;
+    
+    size_t          count;      // Handles in [0, count) have been handed out at least once
+    window_handle_t *free;
+    size_t          num_free;
+    
+    bool            *live;
+    XPLMWindowID    *ref;
+    vect2_t         *last_click;
+    double          *last_hover;
+    layout_change_t *layout;
+    sched_t         *sched;
+    window_handle_t *sched_queue;
+} window_reg_t;
 
 static struct {
     bool            is_init;
     
     char            *output_dir;
-    avl_tree_t      windows;
+    window_reg_t    reg;
+    htbl_t          live_ids;       // Live windows, by zero-padded id
+    
+    int             layout_depth;
+    bool            layout_pending;
+    XPLMFlightLoopID layout_loop;
+    
+    htbl_t          saved;
+    list_t          saved_entries;
+    bool            saved_loaded;
+    time_t          saved_mtime;
+    
+    double          frame_budget;
+    int             sched_frame;
     dr_t            dr_viewport;
     dr_t            dr_vr_enabled;
     
     // XPLMWindowID    overlay;
     
     cursor_t        *cursor;
-    lacf_gl_pic_t   *close;
-    lacf_gl_pic_t   *popout;
-    lacf_gl_pic_t   *resize_l;
-    lacf_gl_pic_t   *resize_r;
-    lacf_gl_pic_t   *keyboard;
+    window_image_t  *close;
+    window_image_t  *popout;
+    window_image_t  *resize_l;
+    window_image_t  *resize_r;
+    window_image_t  *keyboard;
 } sys = {};
 
+#define WIN_REF(w) (sys.reg.ref[(w)->handle])
+#define WIN_LAST_CLICK(w) (sys.reg.last_click[(w)->handle])
+#define WIN_LAST_HOVER(w) (sys.reg.last_hover[(w)->handle])
 
+static window_t *reg_get(window_handle_t handle) {
+    ASSERT3U(handle, <, sys.reg.count);
+    return &sys.reg.chunks[handle / POOL_CHUNK_SIZE][handle % POOL_CHUNK_SIZE];
+}
 
-static void save_window(const window_t *window, conf_t *conf) {
+static window_t *reg_alloc(void) {
+    window_reg_t *reg = &sys.reg;
+    window_handle_t handle;
     
-    bool visible = XPLMGetWindowIsVisible(window->ref);
-    bool is_popped_out = XPLMWindowIsPoppedOut(window->ref);
-    int left, top, right, bottom;
+    if(reg->num_free) {
+        handle = reg->free[--reg->num_free];
+    } else {
+        handle = reg->count++;
+        if(handle == reg->num_chunks * POOL_CHUNK_SIZE) {
+            size_t cap = (reg->num_chunks + 1) * POOL_CHUNK_SIZE;
+            reg->chunks = safe_realloc(reg->chunks, (reg->num_chunks + 1) * sizeof(*reg->chunks));
+            reg->chunks[reg->num_chunks++] = safe_calloc(POOL_CHUNK_SIZE, sizeof(window_t));
+            
+            reg->free = safe_realloc(reg->free, cap * sizeof(*reg->free));
+            reg->live = safe_realloc(reg->live, cap * sizeof(*reg->live));
+            reg->ref = safe_realloc(reg->ref, cap * sizeof(*reg->ref));
+            reg->last_click = safe_realloc(reg->last_click, cap * sizeof(*reg->last_click));
+            reg->last_hover = safe_realloc(reg->last_hover, cap * sizeof(*reg->last_hover));
+            reg->layout = safe_realloc(reg->layout, cap * sizeof(*reg->layout));
+            reg->sched = safe_realloc(reg->sched, cap * sizeof(*reg->sched));
+            reg->sched_queue = safe_realloc(reg->sched_queue, cap * sizeof(*reg->sched_queue));
+        }
+    }
+    
+    window_t *window = reg_get(handle);
+    memset(window, 0, sizeof(*window));
+    window->handle = handle;
     
-    if(!is_popped_out) {
-        XPLMGetWindowGeometry(window->ref, &left, &top, &right, &bottom);
+    reg->live[handle] = true;
+    reg->ref[handle] = NULL;
+    reg->last_click[handle] = NULL_VECT2;
+    reg->last_hover[handle] = 0;
+    reg->layout[handle].mask = 0;
+    memset(&reg->sched[handle], 0, sizeof(reg->sched[handle]));
+    reg->sched[handle].planned = -1;
+    return window;
+}
+
+static void reg_release(window_t *window) {
+    window_reg_t *reg = &sys.reg;
+    ASSERT(reg->live[window->handle]);
+    
+    reg->live[window->handle] = false;
+    reg->ref[window->handle] = NULL;
+    reg->layout[window->handle].mask = 0;
+    reg->free[reg->num_free++] = window->handle;
+}
+
+static void reg_fini(void) {
+    window_reg_t *reg = &sys.reg;
+    for(size_t i = 0; i < reg->num_chunks; ++i) {
+        lacf_free(reg->chunks[i]);
+    }
+    lacf_free(reg->chunks);
+    lacf_free(reg->free);
+    lacf_free(reg->live);
+    lacf_free(reg->ref);
+    lacf_free(reg->last_click);
+    lacf_free(reg->last_hover);
+    lacf_free(reg->layout);
+    lacf_free(reg->sched);
+    lacf_free(reg->sched_queue);
+    memset(reg, 0, sizeof(*reg));
+}
+
+static bool layout_mode_is_current(XPLMWindowID ref, XPLMWindowPositioningMode mode) {
+    bool in_vr = XPLMWindowIsInVR(ref);
+    bool popped_out = XPLMWindowIsPoppedOut(ref);
+    
+    switch(mode) {
+    case xplm_WindowVR: return in_vr;
+    case xplm_WindowPopOut: return popped_out;
+    case xplm_WindowPositionFree: return !in_vr && !popped_out;
+    default: return false;
+    }
+}
+
+static void layout_apply_mode(XPLMWindowID ref, XPLMWindowPositioningMode mode, int monitor) {
+    if(layout_mode_is_current(ref, mode)) return;
+    XPLMSetWindowPositioningMode(ref, mode, monitor);
+}
+
+static void layout_apply_geometry(XPLMWindowID ref, bool os, int left, int top, int right, int bottom) {
+    int l, t, r, b;
+    if(os) {
+        XPLMGetWindowGeometryOS(ref, &l, &t, &r, &b);
+        if(l == left && t == top && r == right && b == bottom) return;
+        XPLMSetWindowGeometryOS(ref, left, top, right, bottom);
     } else {
-        XPLMGetWindowGeometryOS(window->ref, &left, &top, &right, &bottom);
+        XPLMGetWindowGeometry(ref, &l, &t, &r, &b);
+        if(l == left && t == top && r == right && b == bottom) return;
+        XPLMSetWindowGeometry(ref, left, top, right, bottom);
+    }
+}
+
+static void layout_apply_visible(XPLMWindowID ref, bool visible) {
+    if((bool)XPLMGetWindowIsVisible(ref) == visible) return;
+    XPLMSetWindowIsVisible(ref, visible);
+}
+
+static void layout_apply(void) {
+    for(window_handle_t h = 0; h < sys.reg.count; ++h) {
+        layout_change_t *change = &sys.reg.layout[h];
+        if(!sys.reg.live[h] || !change->mask) continue;
+        
+        XPLMWindowID ref = sys.reg.ref[h];
+        if(change->mask & LAYOUT_MODE) {
+            layout_apply_mode(ref, change->mode, change->monitor);
+        }
+        if(change->mask & LAYOUT_GEOM) {
+            layout_apply_geometry(ref, change->geom_os, change->left, change->top, change->right, change->bottom);
+        }
+        if(change->mask & LAYOUT_VISIBLE) {
+            layout_apply_visible(ref, change->visible);
+        }
+        change->mask = 0;
+    }
+    sys.layout_pending = false;
+}
+
+static float layout_loop_cb(float elapsed, float since_last, int counter, void *refcon) {
+    UNUSED(elapsed);
+    UNUSED(since_last);
+    UNUSED(counter);
+    UNUSED(refcon);
+    
+    // A transaction opened since the commit that scheduled us will schedule its own apply when
+    // it commits; applying now would send half of it a frame early.
+    if(sys.layout_depth) {
+        sys.layout_pending = false;
+        return 0;
+    }
+    layout_apply();
+    return 0;
+}
+
+// Outside of a transaction, layout changes go straight to XPLM, and replace whatever change to
+// the same property was still waiting for the next frame.
+static void layout_set_mode(window_t *window, XPLMWindowPositioningMode mode, int monitor) {
+    layout_change_t *change = &sys.reg.layout[window->handle];
+    
+    // Geometry set before a mode switch was meant for the previous mode.
+    change->mask &= ~LAYOUT_GEOM;
+    if(!sys.layout_depth) {
+        change->mask &= ~LAYOUT_MODE;
+        XPLMSetWindowPositioningMode(WIN_REF(window), mode, monitor);
+        return;
+    }
+    change->mask |= LAYOUT_MODE;
+    change->mode = mode;
+    change->monitor = monitor;
+}
+
+static void layout_set_geometry(window_t *window, bool os, int left, int top, int right, int bottom) {
+    layout_change_t *change = &sys.reg.layout[window->handle];
+    
+    if(!sys.layout_depth) {
+        change->mask &= ~LAYOUT_GEOM;
+        if(os) {
+            XPLMSetWindowGeometryOS(WIN_REF(window), left, top, right, bottom);
+        } else {
+            XPLMSetWindowGeometry(WIN_REF(window), left, top, right, bottom);
+        }
+        return;
+    }
+    change->mask |= LAYOUT_GEOM;
+    change->geom_os = os;
+    change->left = left;
+    change->top = top;
+    change->right = right;
+    change->bottom = bottom;
+}
+
+static void layout_set_visible(window_t *window, bool visible) {
+    layout_change_t *change = &sys.reg.layout[window->handle];
+    
+    if(!sys.layout_depth) {
+        change->mask &= ~LAYOUT_VISIBLE;
+        XPLMSetWindowIsVisible(WIN_REF(window), visible);
+        return;
     }
+    change->mask |= LAYOUT_VISIBLE;
+    change->visible = visible;
+}
+
+void window_layout_begin(void) {
+    VERIFY(sys.is_init);
+    sys.layout_depth += 1;
+}
+
+void window_layout_commit(void) {
+    VERIFY(sys.is_init);
+    VERIFY3S(sys.layout_depth, >, 0);
     
-    conf_set_i_v(conf, "%s/pos/left", left, window->conf.id);
-    conf_set_i_v(conf, "%s/pos/right", right, window->conf.id);
-    conf_set_i_v(conf, "%s/pos/top", top, window->conf.id);
-    conf_set_i_v(conf, "%s/pos/bottom", bottom, window->conf.id);
+    if(--sys.layout_depth) return;
+    if(sys.layout_pending) return;
     
+    sys.layout_pending = true;
+    XPLMScheduleFlightLoop(sys.layout_loop, -1, 1);
+}
+
+// acfutils conf lowercases its keys, so ids read back from windows.txt are lowercase. Saved
+// layouts are keyed by the lowercased id, to match both those and live windows' ids.
+static void saved_key(layout_key_t key, const char *id) {
+    memset(key, 0, sizeof(layout_key_t));
+    for(size_t i = 0; i < sizeof(layout_key_t) - 1 && id[i]; ++i) {
+        key[i] = tolower((unsigned char)id[i]);
+    }
+}
+
+// Live windows are keyed by their exact id, the way window_find() has always matched them.
+static void live_key(layout_key_t key, const char *id) {
+    memset(key, 0, sizeof(layout_key_t));
+    lacf_strlcpy(key, id, sizeof(layout_key_t));
+}
+
+static layout_entry_t *saved_find(const char *id) {
+    layout_key_t key;
+    saved_key(key, id);
+    return htbl_lookup(&sys.saved, key);
+}
+
+static layout_entry_t *saved_get(const char *id) {
+    layout_entry_t *entry = saved_find(id);
+    if(entry) return entry;
     
-    conf_set_b_v(conf, "%s/visible", visible, window->conf.id);
-    conf_set_b_v(conf, "%s/popout", is_popped_out, window->conf.id);
+    entry = safe_calloc(1, sizeof(*entry));
+    saved_key(entry->id, id);
+    htbl_set(&sys.saved, entry->id, entry);
+    list_insert_tail(&sys.saved_entries, entry);
+    return entry;
+}
+
+static void saved_clear(void) {
+    htbl_empty(&sys.saved, NULL, NULL);
+    layout_entry_t *entry = NULL;
+    while((entry = list_remove_head(&sys.saved_entries)) != NULL) {
+        lacf_free(entry);
+    }
 }
 
+static bool saved_stat(const char *path, time_t *mtime) {
+    struct stat st;
+    if(stat(path, &st) != 0) return false;
+    *mtime = st.st_mtime;
+    return true;
+}
 
-static void restore_window(window_t *window, conf_t *conf) {
-    int left = 0, top = 0, right = 0, bottom = 0;
+static void saved_load(const conf_t *conf) {
+    saved_clear();
+    
+    static const char suffix[] = "/visible";
+    const size_t suffix_len = sizeof(suffix) - 1;
     
-    if(!conf_get_i_v(conf, "%s/pos/left", &left, window->conf.id)) return;
-    if(!conf_get_i_v(conf, "%s/pos/right", &right, window->conf.id)) return;
-    if(!conf_get_i_v(conf, "%s/pos/top", &top, window->conf.id)) return;
-    if(!conf_get_i_v(conf, "%s/pos/bottom", &bottom, window->conf.id)) return;
+    void *cookie = NULL;
+    const char *key = NULL, *value = NULL;
+    while(conf_walk(conf, &cookie, &key, &value)) {
+        size_t len = strlen(key);
+        if(len <= suffix_len || strcmp(key + len - suffix_len, suffix)) continue;
+        
+        layout_key_t id = {};
+        if(len - suffix_len >= sizeof(id)) continue;
+        memcpy(id, key, len - suffix_len);
+        
+        int left = 0, top = 0, right = 0, bottom = 0;
+        if(!conf_get_i_v(conf, "%s/pos/left", &left, id)) continue;
+        if(!conf_get_i_v(conf, "%s/pos/right", &right, id)) continue;
+        if(!conf_get_i_v(conf, "%s/pos/top", &top, id)) continue;
+        if(!conf_get_i_v(conf, "%s/pos/bottom", &bottom, id)) continue;
+        
+        bool_t visible = false, is_popped_out = false;
+        if(!conf_get_b_v(conf, "%s/visible", &visible, id)) continue;
+        conf_get_b_v(conf, "%s/popout", &is_popped_out, id);
+        
+        layout_entry_t *entry = saved_get(id);
+        entry->left = left;
+        entry->top = top;
+        entry->right = right;
+        entry->bottom = bottom;
+        entry->visible = visible;
+        entry->popout = is_popped_out;
+    }
+}
+
+static void save_window(const window_t *window) {
+    layout_entry_t *entry = saved_get(window->conf.id);
+    
+    entry->visible = XPLMGetWindowIsVisible(WIN_REF(window));
+    entry->popout = XPLMWindowIsPoppedOut(WIN_REF(window));
+    
+    if(!entry->popout) {
+        XPLMGetWindowGeometry(WIN_REF(window), &entry->left, &entry->top, &entry->right, &entry->bottom);
+    } else {
+        XPLMGetWindowGeometryOS(WIN_REF(window), &entry->left, &entry->top, &entry->right, &entry->bottom);
+    }
+}
+
+static void save_entry(const layout_entry_t *entry, conf_t *conf) {
+    conf_set_i_v(conf, "%s/pos/left", entry->left, entry->id);
+    conf_set_i_v(conf, "%s/pos/right", entry->right, entry->id);
+    conf_set_i_v(conf, "%s/pos/top", entry->top, entry->id);
+    conf_set_i_v(conf, "%s/pos/bottom", entry->bottom, entry->id);
     
-    bool_t visible = false, is_popped_out = false;
-    if(!conf_get_b_v(conf, "%s/visible", &visible, window->conf.id)) return;
-    conf_get_b_v(conf, "%s/popout", &is_popped_out, window->conf.id);
     
+    conf_set_b_v(conf, "%s/visible", entry->visible, entry->id);
+    conf_set_b_v(conf, "%s/popout", entry->popout, entry->id);
+}
+
+
+static void restore_window(window_t *window, const layout_entry_t *entry) {
     if(dr_geti(&sys.dr_vr_enabled) == 1) {
-        XPLMSetWindowPositioningMode(window->ref, xplm_WindowVR, -1);
-    } else if(is_popped_out) {
-    	XPLMSetWindowPositioningMode(window->ref, xplm_WindowPopOut, -1);
-        XPLMSetWindowGeometryOS(window->ref, left, top, right, bottom);
+        layout_set_mode(window, xplm_WindowVR, -1);
+    } else if(entry->popout) {
+    	layout_set_mode(window, xplm_WindowPopOut, -1);
+        layout_set_geometry(window, true, entry->left, entry->top, entry->right, entry->bottom);
     } else {
-        XPLMSetWindowGeometry(window->ref, left, top, right, bottom);
+        layout_set_geometry(window, false, entry->left, entry->top, entry->right, entry->bottom);
     }
-    XPLMSetWindowIsVisible(window->ref, visible);
+    layout_set_visible(window, entry->visible);
 }
 
+// Windows that aren't alive right now keep whatever was saved for them last.
 void window_sys_save() {
     VERIFY(sys.is_init);
+    trace_begin("window_sys_save");
+    
+    // Save what the layout will be, not what it was before the last batch of changes.
+    if(sys.layout_pending && !sys.layout_depth) layout_apply();
+    
+    for(window_handle_t h = 0; h < sys.reg.count; ++h) {
+        if(!sys.reg.live[h]) continue;
+        save_window(reg_get(h));
+    }
     
     conf_t *conf = conf_create_empty();
-    for(window_t *win = avl_first(&sys.windows); win != NULL; win = AVL_NEXT(&sys.windows, win)) {
-        save_window(win, conf);
+    for(const layout_entry_t *entry = list_head(&sys.saved_entries); entry;
+        entry = list_next(&sys.saved_entries, entry)) {
+        save_entry(entry, conf);
     }
     
     char *path = mkpathname(sys.output_dir, "windows.txt", NULL);
     if(!conf_write_file(conf, path)) {
         logMsg("could not save window positions to `%s`", path);
+    } else if(saved_stat(path, &sys.saved_mtime)) {
+        // What's in memory is what was just written, no need to read it back.
+        sys.saved_loaded = true;
     }
     
     lacf_free(path);
     conf_free(conf);
+    trace_end("window_sys_save");
 }
 
 void window_sys_restore() {
     VERIFY(sys.is_init);
+    trace_begin("window_sys_restore");
     
     char *path = mkpathname(sys.output_dir, "windows.txt", NULL);
-    if(!file_exists(path, NULL)) {
+    time_t mtime = 0;
+    if(!saved_stat(path, &mtime)) {
         lacf_free(path);
+        trace_end("window_sys_restore");
         return;
     }
     
-    int errline = 0;
-    conf_t *conf = conf_read_file(path, &errline);
-    
-    if(!conf) {
-        logMsg("error in window positions file at line %d", errline);
-        lacf_free(path);
-        window_sys_save();
-        return;
+    if(!sys.saved_loaded || mtime != sys.saved_mtime) {
+        int errline = 0;
+        conf_t *conf = conf_read_file(path, &errline);
+        
+        if(!conf) {
+            logMsg("error in window positions file at line %d", errline);
+            lacf_free(path);
+            window_sys_save();
+            trace_end("window_sys_restore");
+            return;
+        }
+        saved_load(conf);
+        conf_free(conf);
+        sys.saved_loaded = true;
+        sys.saved_mtime = mtime;
     }
     lacf_free(path);
     
-    for(window_t *win = avl_first(&sys.windows); win != NULL; win = AVL_NEXT(&sys.windows, win)) {
-        restore_window(win, conf);
+    window_layout_begin();
+    for(window_handle_t h = 0; h < sys.reg.count; ++h) {
+        if(!sys.reg.live[h]) continue;
+        window_t *window = reg_get(h);
+        const layout_entry_t *entry = saved_find(window->conf.id);
+        if(entry) restore_window(window, entry);
     }
-    conf_free(conf);
+    window_layout_commit();
+    trace_end("window_sys_restore");
 }
 
 static bool is_out_of_bounds(const window_t *window) {
@@ -160,56 +547,86 @@ static bool is_out_of_bounds(const window_t *window) {
     XPLMGetScreenSize(&screen_w, &screen_h);
     
     int left, top, right, bottom;
-    XPLMGetWindowGeometry(window->ref, &left, &top, &right, &bottom);
+    XPLMGetWindowGeometry(WIN_REF(window), &left, &top, &right, &bottom);
     return left > screen_w - MARGIN || right < MARGIN || top > screen_h - MARGIN || bottom < MARGIN;
 }
 
 static bool is_in_button(const window_t *window, vect2_t button, vect2_t click) {
     return !window->conf.is_decorated
-        && !XPLMWindowIsPoppedOut(window->ref) && !XPLMWindowIsInVR(window->ref)
+        && !XPLMWindowIsPoppedOut(WIN_REF(window)) && !XPLMWindowIsInVR(WIN_REF(window))
         && click.x > button.x && click.x < button.x + BUTTON_SIZE
         && click.y > button.y && click.y < button.y + BUTTON_SIZE;
 }
 
 static vect2_t close_button_pos(const window_t *window) {
     int left, top, right, bottom;
-    XPLMGetWindowGeometry(window->ref, &left, &top, &right, &bottom);
+    XPLMGetWindowGeometry(WIN_REF(window), &left, &top, &right, &bottom);
     return VECT2(left, top - BUTTON_SIZE);
 }
 
 static vect2_t popout_button_pos(const window_t *window) {
     int left, top, right, bottom;
-    XPLMGetWindowGeometry(window->ref, &left, &top, &right, &bottom);
+    XPLMGetWindowGeometry(WIN_REF(window), &left, &top, &right, &bottom);
     return VECT2(right - BUTTON_SIZE, top - BUTTON_SIZE);
 }
 
+int window_route_key(window_t *window, char key, XPLMKeyFlags flags, char vkey, int lose,
+                     window_route_t *route) {
+    *route = WINDOW_ROUTE_NONE;
+    if(lose) {
+        *route = WINDOW_ROUTE_FOCUS_LOST;
+        return 0;
+    }
+    if(!(flags & xplm_DownFlag)) return 0;
+    if(!window->conf.key) return 0;
+    trace_begin("key_cb");
+    window->conf.key(window, (int)vkey, key, flags & xplm_ControlFlag, window->refcon);
+    trace_end("key_cb");
+    *route = WINDOW_ROUTE_CALLBACK;
+    return 1;
+}
+
 static void handle_key(XPLMWindowID id, char key, XPLMKeyFlags flags, char vkey, void *refcon, int lose) {
     UNUSED(id);
-    UNUSED(key);
-    UNUSED(flags);
     
-    if(lose) return;
-    if(!(flags & xplm_DownFlag)) return;
     window_t *window = refcon;
-    if(window->conf.key) window->conf.key(window, (int)vkey, key, flags & xplm_ControlFlag, window->refcon);
+    trace_begin("handle_key");
+    window_route_t route;
+    int result = window_route_key(window, key, flags, vkey, lose, &route);
+    rec_key(window, key, flags, vkey, lose, result, route);
+    trace_end("handle_key");
 }
 
-static XPLMCursorStatus default_cursor(XPLMWindowID id, int x, int y, void *refcon) {
-    UNUSED(id);
-    UNUSED(x);
-    UNUSED(y);
-    
-    window_t *window = refcon;
-    if(!XPLMIsWindowInFront(window->ref)) return xplm_CursorDefault;
-    window->last_hover = microclock();
+XPLMCursorStatus window_route_cursor(window_t *window, int x, int y, window_route_t *route) {
+    *route = WINDOW_ROUTE_NONE;
+    if(!XPLMIsWindowInFront(WIN_REF(window))) {
+        *route = WINDOW_ROUTE_BEHIND;
+        return xplm_CursorDefault;
+    }
+    WIN_LAST_HOVER(window) = microclock();
         
     vect2_t pos = VECT2(x, y);
-    if(is_in_button(window, close_button_pos(window), pos) || is_in_button(window, popout_button_pos(window), pos)) {
-        cursor_make_current(sys.cursor);
-        return xplm_CursorCustom;
+    if(is_in_button(window, close_button_pos(window), pos)) {
+        *route = WINDOW_ROUTE_CLOSE;
+    } else if(is_in_button(window, popout_button_pos(window), pos)) {
+        *route = WINDOW_ROUTE_POPOUT;
+    } else {
+        return xplm_CursorDefault;
     }
+    cursor_make_current(sys.cursor);
+    return xplm_CursorCustom;
+}
+
+static XPLMCursorStatus default_cursor(XPLMWindowID id, int x, int y, void *refcon) {
+    UNUSED(id);
     
-    return xplm_CursorDefault;
+    window_t *window = refcon;
+    trace_begin("handle_cursor");
+    window_route_t route;
+    XPLMCursorStatus result = window_route_cursor(window, x, y, &route);
+    rec_cursor(window, x, y, result, route);
+    trace_end("handle_cursor");
+    return result;
 }
 
 static int default_scroll(XPLMWindowID id, int x, int y, int wheel, int clicks, void *refcon) {
@@ -232,74 +649,92 @@ static int default_click(XPLMWindowID id, int x, int y, XPLMMouseStatus s, void
 }
 
 
-static int handle_click(XPLMWindowID id, int x, int y, XPLMMouseStatus status, void *refcon) {
-    UNUSED(id);
-    window_t *window = refcon;
-    
+// Scale of the window on screen, relative to the size it was created with.
+static vect2_t content_scale(const window_t *window, int left, int top, int right, int bottom) {
+    return VECT2((right - left) / window->conf.size.x, (top - bottom) / window->conf.size.y);
+}
+
+static int user_click(window_t *window, mouse_action_t act, vect2_t pos, vect2_t scale) {
+    trace_begin("click_cb");
+    int result = window->conf.click(window, act, pos, scale, window->refcon);
+    trace_end("click_cb");
+    return result;
+}
+
+int window_route_click(window_t *window, int x, int y, XPLMMouseStatus status, window_route_t *route) {
+    *route = WINDOW_ROUTE_NONE;
     vect2_t click = VECT2(x, y);
     int left, top, right, bottom;
-    XPLMGetWindowGeometry(window->ref, &left, &top, &right, &bottom);
+    XPLMGetWindowGeometry(WIN_REF(window), &left, &top, &right, &bottom);
     vect2_t click_win = window_desk2win(window, click);
     
-    vect2_t size = VECT2(right - left, top - bottom);
-    vect2_t scale = VECT2(size.x / window->conf.size.x, size.y / window->conf.size.y);
+    vect2_t scale = content_scale(window, left, top, right, bottom);
     
     vect2_t close_button = close_button_pos(window);
     vect2_t popout_button = popout_button_pos(window);
     
     switch(status) {
     case xplm_MouseDown:
-        window->last_click = NULL_VECT2;
+        WIN_LAST_CLICK(window) = NULL_VECT2;
         
-        if(window->conf.key && !XPLMHasKeyboardFocus(window->ref)) {
-            XPLMTakeKeyboardFocus(window->ref);
+        if(window->conf.key && !XPLMHasKeyboardFocus(WIN_REF(window))) {
+            XPLMTakeKeyboardFocus(WIN_REF(window));
         }
         
         if(!window->conf.is_decorated && is_in_button(window, close_button, click)) {
             window_hide(window);
+            *route = WINDOW_ROUTE_CLOSE;
             return 1;
         }
         
         if(!window->conf.is_decorated && is_in_button(window, popout_button, click)) {
             window_pop_out(window);
+            *route = WINDOW_ROUTE_POPOUT;
             return 1;
         }
         
-        if(window->conf.click && window->conf.click(window, WINDOW_MOUSE_DOWN, click_win, scale, window->refcon)) {
+        if(window->conf.click && user_click(window, WINDOW_MOUSE_DOWN, click_win, scale)) {
+            *route = WINDOW_ROUTE_CALLBACK;
             return 1;    
         } else if(
-            !XPLMWindowIsPoppedOut(window->ref)
-            && !XPLMWindowIsInVR(window->ref)
+            !XPLMWindowIsPoppedOut(WIN_REF(window))
+            && !XPLMWindowIsInVR(WIN_REF(window))
             && click.x > left + RESIZE_MARGIN
             && click.x < right - RESIZE_MARGIN
             && click.y > bottom + RESIZE_MARGIN
             && click.y < top - RESIZE_MARGIN
         ) {
-            window->last_click = click;
+            WIN_LAST_CLICK(window) = click;
+            *route = WINDOW_ROUTE_DRAG_START;
             return 1;
         }
         break;
         
     case xplm_MouseDrag:
-        if(!IS_NULL_VECT2(window->last_click)) {
-            vect2_t diff = vect2_sub(click, window->last_click);
-            window->last_click = click;
-            XPLMSetWindowGeometry(window->ref, left + diff.x, top + diff.y, right + diff.x, bottom + diff.y);
+        if(!IS_NULL_VECT2(WIN_LAST_CLICK(window))) {
+            vect2_t diff = vect2_sub(click, WIN_LAST_CLICK(window));
+            WIN_LAST_CLICK(window) = click;
+            layout_set_geometry(window, false, left + diff.x, top + diff.y, right + diff.x, bottom + diff.y);
+            *route = WINDOW_ROUTE_DRAG;
             return 1;
         } else if(window->conf.click) {
-            return window->conf.click(window, WINDOW_MOUSE_MOVE, click_win, scale, window->refcon);
+            int result = user_click(window, WINDOW_MOUSE_MOVE, click_win, scale);
+            *route = result ? WINDOW_ROUTE_CALLBACK : WINDOW_ROUTE_CALLBACK_PASSED;
+            return result;
         }
         break;
         
     case xplm_MouseUp:
-        if(!IS_NULL_VECT2(window->last_click)) {
-            window->last_click = NULL_VECT2;
+        if(!IS_NULL_VECT2(WIN_LAST_CLICK(window))) {
+            WIN_LAST_CLICK(window) = NULL_VECT2;
+            *route = WINDOW_ROUTE_DRAG_END;
             return 1;
         } else {
             if(window->conf.click) {
-                window->conf.click(window, WINDOW_MOUSE_UP, click_win, scale, window->refcon);
+                user_click(window, WINDOW_MOUSE_UP, click_win, scale);
+                *route = WINDOW_ROUTE_CALLBACK_PASSED;
             }
-            window->last_click = NULL_VECT2;
+            WIN_LAST_CLICK(window) = NULL_VECT2;
             return 0;
         }
         break;
@@ -307,13 +742,147 @@ static int handle_click(XPLMWindowID id, int x, int y, XPLMMouseStatus status, v
     return 0;
 }
 
+static int handle_click(XPLMWindowID id, int x, int y, XPLMMouseStatus status, void *refcon) {
+    UNUSED(id);
+    
+    window_t *window = refcon;
+    trace_begin("handle_click");
+    window_route_t route;
+    int result = window_route_click(window, x, y, status, &route);
+    rec_click(window, x, y, status, result, route);
+    trace_end("handle_click");
+    return result;
+}
+
 static void handle_focus(window_t *window) {
     if(!window->conf.key) return;
-    if(!XPLMIsWindowInFront(window->ref) && XPLMHasKeyboardFocus(window->ref)) {
+    if(!XPLMIsWindowInFront(WIN_REF(window)) && XPLMHasKeyboardFocus(WIN_REF(window))) {
         XPLMTakeKeyboardFocus(NULL);
     }
 }
 
+static double render_cap(const window_t *window) {
+    switch(window->conf.render) {
+    case WINDOW_RENDER_NATIVE: return 0;
+    case WINDOW_RENDER_QUALITY: return 2.0;
+    case WINDOW_RENDER_BALANCED: return 1.0;
+    case WINDOW_RENDER_PERFORMANCE: return 0.5;
+    case WINDOW_RENDER_CUSTOM: return window->conf.render_scale;
+    }
+    return 0;
+}
+
+// Returns the resolution to render the window's content at, or NULL_VECT2 to draw it directly.
+static vect2_t render_size(const window_t *window, vect2_t size) {
+    double cap = render_cap(window);
+    if(cap <= 0) return NULL_VECT2;
+    
+    vect2_t max = VECT2(window->conf.size.x * cap, window->conf.size.y * cap);
+    if(size.x <= max.x && size.y <= max.y) return NULL_VECT2;
+    
+    double scale = MIN(max.x / size.x, max.y / size.y);
+    return VECT2(MAX(round(size.x * scale), 1), MAX(round(size.y * scale), 1));
+}
+
+static int sched_cmp(const void *p1, const void *p2) {
+    const sched_t *s1 = &sys.reg.sched[*(const window_handle_t *)p1];
+    const sched_t *s2 = &sys.reg.sched[*(const window_handle_t *)p2];
+    
+    // Windows that keep getting skipped slowly climb up the queue.
+    long long prio1 = (long long)s1->priority + s1->starved;
+    long long prio2 = (long long)s2->priority + s2->starved;
+    if(prio1 > prio2) return -1;
+    if(prio1 < prio2) return 1;
+    if(s1->last_draw < s2->last_draw) return -1;
+    if(s1->last_draw > s2->last_draw) return 1;
+    return 0;
+}
+
+// Picks which scheduled windows get to redraw this frame. Runs once per frame, from whichever
+// window is drawn first.
+static void sched_plan(void) {
+    int frame = XPLMGetCycleNumber();
+    if(frame == sys.sched_frame) return;
+    sys.sched_frame = frame;
+    
+    uint64_t now = microclock();
+    size_t num_due = 0;
+    
+    for(window_handle_t h = 0; h < sys.reg.count; ++h) {
+        const sched_t *sched = &sys.reg.sched[h];
+        if(!sys.reg.live[h] || !sched->period) continue;
+        if(now - sched->last_draw < sched->period) continue;
+        if(!XPLMGetWindowIsVisible(sys.reg.ref[h])) continue;
+        sys.reg.sched_queue[num_due++] = h;
+    }
+    qsort(sys.reg.sched_queue, num_due, sizeof(*sys.reg.sched_queue), sched_cmp);
+    
+    double budget = sys.frame_budget;
+    for(size_t i = 0; i < num_due; ++i) {
+        sched_t *sched = &sys.reg.sched[sys.reg.sched_queue[i]];
+        
+        // The first window in the queue always gets drawn, so nothing can starve forever.
+        if(sys.frame_budget <= 0 || i == 0 || sched->draw_time <= budget) {
+            sched->planned = frame;
+            budget -= sched->draw_time;
+        } else {
+            sched->starved += 1;
+            sched->skipped += 1;
+            if(sched->starved > sched->starved_max) sched->starved_max = sched->starved;
+        }
+    }
+}
+
+static void sched_drawn(window_t *window, uint64_t start, uint64_t end) {
+    sched_t *sched = &sys.reg.sched[window->handle];
+    double time = (end - start) / 1e3;
+    
+    sched->draw_time = sched->drawn ? 0.8 * sched->draw_time + 0.2 * time : time;
+    sched->last_draw = end;
+    sched->starved = 0;
+    sched->drawn += 1;
+    
+    // The plan holds for the whole frame, and windows can be drawn more than once per frame (VR
+    // eyes, popped-out windows). Later draws reuse the offscreen image.
+    sched->planned = -1;
+}
+
+static void user_draw(window_t *window, vect2_t pos, vect2_t size) {
+    trace_begin("draw_cb");
+    window->conf.draw(window, pos, size, window->refcon);
+    gls_invalidate();
+    trace_end("draw_cb");
+}
+
+static void draw_content(window_t *window, vect2_t pos, vect2_t size) {
+    const sched_t *sched = &sys.reg.sched[window->handle];
+    vect2_t res = render_size(window, size);
+    
+    if(!sched->period) {
+        if(!IS_NULL_VECT2(res) && offscreen_begin(&window->offscreen, res)) {
+            user_draw(window, VECT2(0, 0), res);
+            offscreen_end(&window->offscreen);
+            offscreen_draw(&window->offscreen, pos, size);
+        } else {
+            user_draw(window, pos, size);
+        }
+        return;
+    }
+    
+    // Scheduled windows always render offscreen, so there's an image to show when they're skipped.
+    if(IS_NULL_VECT2(res)) res = size;
+    sched_plan();
+    
+    bool resized = window->offscreen.size.x != res.x || window->offscreen.size.y != res.y;
+    if((sched->planned == sys.sched_frame || resized) && offscreen_begin(&window->offscreen, res)) {
+        uint64_t start = microclock();
+        user_draw(window, VECT2(0, 0), res);
+        offscreen_end(&window->offscreen);
+        sched_drawn(window, start, microclock());
+    }
+    offscreen_draw(&window->offscreen, pos, size);
+}
+
 static void handle_draw(XPLMWindowID id, void *refcon) {
     UNUSED(id);
     window_t *window = refcon;
@@ -322,46 +891,43 @@ static void handle_draw(XPLMWindowID id, void *refcon) {
         win_resize_ctl_update(&window->resize_ctl);
     }
     
-    if(!XPLMGetWindowIsVisible(window->ref)) return;
+    if(!XPLMGetWindowIsVisible(WIN_REF(window))) return;
     
+    trace_begin("handle_draw");
     handle_focus(window);
+    gls_pass_begin();
     
     int left, top, right, bottom;
-    XPLMGetWindowGeometry(window->ref, &left, &top, &right, &bottom);
+    XPLMGetWindowGeometry(WIN_REF(window), &left, &top, &right, &bottom);
     
-    bool is_in_sim_window = !XPLMWindowIsPoppedOut(window->ref) && !XPLMWindowIsInVR(window->ref);
-    bool buttons_faded_in = microclock() - window->last_hover < BUTTON_HOVER_DELAY * 1e6;
+    bool is_in_sim_window = !XPLMWindowIsPoppedOut(WIN_REF(window)) && !XPLMWindowIsInVR(WIN_REF(window));
+    bool buttons_faded_in = microclock() - WIN_LAST_HOVER(window) < BUTTON_HOVER_DELAY * 1e6;
     
     if(window->conf.draw) {
-        window->conf.draw(
-            window,
-            VECT2(left, bottom),
-            VECT2(right-left, top-bottom),
-            window->refcon
-        );
+        draw_content(window, VECT2(left, bottom), VECT2(right-left, top-bottom));
     }
     
     if(!window->conf.is_decorated && is_in_sim_window && buttons_faded_in) {
-        lacf_gl_pic_draw(
+        window_image_draw(
             sys.close,
             VECT2(left, top - BUTTON_SIZE),
             VECT2(BUTTON_SIZE, BUTTON_SIZE),
             0.8
         );
-        lacf_gl_pic_draw(
+        window_image_draw(
             sys.popout,
             VECT2(right - BUTTON_SIZE, top - BUTTON_SIZE),
             VECT2(BUTTON_SIZE, BUTTON_SIZE),
             0.8
         );
             
-        lacf_gl_pic_draw(
+        window_image_draw(
             sys.resize_l,
             VECT2(left, bottom),
             VECT2(24, 24),
             0.5
         );
-        lacf_gl_pic_draw(
+        window_image_draw(
             sys.resize_r,
             VECT2(right - 24, bottom),
             VECT2(24, 24),
@@ -384,36 +950,29 @@ static void handle_draw(XPLMWindowID id, void *refcon) {
 
         XPLMDrawTranslucentDarkBox(x1 - 5, y, x2 + 5, y - height);
         XPLMDrawString(color, x1, y - 10, title, NULL, xplmFont_Basic);
+        gls_invalidate();
     }
     
-    if(XPLMHasKeyboardFocus(window->ref)) {
+    if(XPLMHasKeyboardFocus(WIN_REF(window))) {
         double t = microclock() / 1e6;
         
-        lacf_gl_pic_draw(
+        window_image_draw(
             sys.keyboard,
             VECT2(left + BUTTON_SIZE, top - BUTTON_SIZE),
             VECT2(KEYBOARD_WIDTH, KEYBOARD_HEIGHT),
             0.5 + 0.5 * sin(t * 5)
         );
     }
+    
+    gls_pass_end();
+    trace_end("handle_draw");
 }
 
-static lacf_gl_pic_t *load_image(const char *dir, const char *name) {
+static window_image_t *load_image(const char *dir, const char *name) {
     char *path = mkpathname(dir, "data", "images", name, NULL);
-    lacf_gl_pic_t *pic = lacf_gl_pic_new(path);
-    VERIFY3P(pic, !=, NULL);
+    window_image_t *image = window_image_get(path);
     lacf_free(path);
-    return pic;
-}
-
-static int window_cmp(const void *wp1, const void *wp2) {
-    const window_t *w1 = wp1;
-    const window_t *w2 = wp2;
-    
-    int result = strcmp(w1->conf.id, w2->conf.id);
-    if(result < 0) return -1;
-    if(result > 0) return 1;
-    return 0;
+    return image;
 }
 
 
@@ -422,6 +981,7 @@ void window_sys_init(const char *dir, const char *output_dir) {
     fdr_find(&sys.dr_viewport, "sim/graphics/view/viewport");
     fdr_find(&sys.dr_vr_enabled, "sim/graphics/VR/enabled");
     
+    image_sys_init();
     sys.close = load_image(dir, "close.png");
     sys.popout = load_image(dir, "popout.png");
     sys.resize_l = load_image(dir, "resize_l.png");
@@ -433,8 +993,25 @@ void window_sys_init(const char *dir, const char *output_dir) {
     sys.cursor = cursor_read_from_file(cursor_path);
     VERIFY3P(sys.cursor, !=, NULL);
     
-    avl_create(&sys.windows, window_cmp, sizeof(window_t), offsetof(window_t, mgr_node));
     sys.output_dir = safe_strdup(output_dir);
+    htbl_create(&sys.live_ids, ID_BUCKETS, sizeof(layout_key_t), false);
+    htbl_create(&sys.saved, LAYOUT_BUCKETS, sizeof(layout_key_t), false);
+    list_create(&sys.saved_entries, sizeof(layout_entry_t), offsetof(layout_entry_t, node));
+    sys.saved_loaded = false;
+    sys.saved_mtime = 0;
+    trace_sys_init(output_dir);
+    
+    XPLMCreateFlightLoop_t loop = {
+        .structSize = sizeof(loop),
+        .phase = xplm_FlightLoop_Phase_BeforeFlightModel,
+        .callbackFunc = layout_loop_cb,
+        .refcon = NULL
+    };
+    sys.layout_loop = XPLMCreateFlightLoop(&loop);
+    sys.layout_depth = 0;
+    sys.layout_pending = false;
+    sys.frame_budget = 0;
+    sys.sched_frame = -1;
     
     sys.is_init = true;
 }
@@ -445,39 +1022,68 @@ void window_sys_fini(void) {
     if(!sys.is_init) return;
     sys.is_init = false;
     
-    window_t *window = NULL;
-    void *cookie = NULL;
-    while((window = avl_destroy_nodes(&sys.windows, &cookie)) != NULL) {
-        window_destroy_private(window);
+    rec_fini();
+    XPLMDestroyFlightLoop(sys.layout_loop);
+    sys.layout_loop = NULL;
+    
+    for(window_handle_t h = 0; h < sys.reg.count; ++h) {
+        if(!sys.reg.live[h]) continue;
+        window_destroy_private(reg_get(h));
     }
-    avl_destroy(&sys.windows);
+    reg_fini();
+    htbl_destroy(&sys.live_ids);
     
     // XPLMDestroyWindow(sys.overlay);
-    lacf_gl_pic_destroy(sys.close);
-    lacf_gl_pic_destroy(sys.popout);
-    lacf_gl_pic_destroy(sys.keyboard);
+    window_image_release(sys.close);
+    window_image_release(sys.popout);
+    window_image_release(sys.resize_l);
+    window_image_release(sys.resize_r);
+    window_image_release(sys.keyboard);
+    image_sys_fini();
+    quad_sys_fini();
+    trace_sys_fini();
     cursor_free(sys.cursor);
     lacf_free(sys.output_dir);
+    saved_clear();
+    htbl_destroy(&sys.saved);
+    list_destroy(&sys.saved_entries);
     
     sys.close = NULL;
     sys.popout = NULL;
+    sys.resize_l = NULL;
+    sys.resize_r = NULL;
     sys.keyboard = NULL;
     sys.cursor = NULL;
     sys.output_dir = NULL;
 }
 
+window_t *window_find(const char *id) {
+    ASSERT3P(id, !=, NULL);
+    if(!sys.is_init) return NULL;
+    
+    layout_key_t key;
+    live_key(key, id);
+    return htbl_lookup(&sys.live_ids, key);
+}
+
 void window_sys_move_to_vr(void) {
     if(!sys.is_init) return;
-    for(window_t *win = avl_first(&sys.windows); win != NULL; win = AVL_NEXT(&sys.windows, win)) {
-        XPLMSetWindowPositioningMode(win->ref, xplm_WindowVR, 0);
+    window_layout_begin();
+    for(window_handle_t h = 0; h < sys.reg.count; ++h) {
+        if(!sys.reg.live[h]) continue;
+        layout_set_mode(reg_get(h), xplm_WindowVR, 0);
     }
+    window_layout_commit();
 }
 
 void window_sys_move_to_2d(void) {
     if(!sys.is_init) return;
-    for(window_t *win = avl_first(&sys.windows); win != NULL; win = AVL_NEXT(&sys.windows, win)) {
-        XPLMSetWindowPositioningMode(win->ref, xplm_WindowPositionFree, -1);
+    window_layout_begin();
+    for(window_handle_t h = 0; h < sys.reg.count; ++h) {
+        if(!sys.reg.live[h]) continue;
+        layout_set_mode(reg_get(h), xplm_WindowPositionFree, -1);
     }
+    window_layout_commit();
 }
 
 
@@ -492,7 +1098,23 @@ static void strreplace(char *str, const char *matches, char replace) {
 window_t *window_new(const window_conf_t *conf, void *refcon) {
     ASSERT3P(conf, !=, NULL);
     
-    window_t *window = safe_calloc(1, sizeof(*window));
+    window_t *window = reg_alloc();
+    window->conf = *conf;
+    window->refcon = refcon;
+    
+    if(!strlen(window->conf.id)) {
+        lacf_strlcpy(window->conf.id, window->conf.name, sizeof(window->conf.id));
+        strreplace(window->conf.id, " \t/\\~!@#$%^&*()-+=", '_');
+    }
+    
+    // Ids key window_find(), saved layouts and recordings, so they must be unique.
+    layout_key_t key;
+    live_key(key, window->conf.id);
+    VERIFY_MSG(htbl_lookup(&sys.live_ids, key) == NULL, "duplicate window id `%s`", window->conf.id);
+    htbl_set(&sys.live_ids, key, window);
+    
+    // Once windows.txt has been read, windows created later go straight where they were saved.
+    const layout_entry_t *entry = sys.saved_loaded ? saved_find(window->conf.id) : NULL;
     
     XPLMCreateWindow_t cfg = {};
     cfg.structSize = sizeof(cfg);
@@ -503,56 +1125,60 @@ window_t *window_new(const window_conf_t *conf, void *refcon) {
     cfg.handleMouseClickFunc = handle_click;
     cfg.handleRightClickFunc = default_click;
     cfg.handleMouseWheelFunc = default_scroll;
-    cfg.left = 100;
-    cfg.right = cfg.left + conf->size.x;
-    cfg.bottom = 100;
-    cfg.top = cfg.bottom + conf->size.y;
+    if(entry && !entry->popout) {
+        cfg.left = entry->left;
+        cfg.right = entry->right;
+        cfg.bottom = entry->bottom;
+        cfg.top = entry->top;
+    } else {
+        cfg.left = 100;
+        cfg.right = cfg.left + conf->size.x;
+        cfg.bottom = 100;
+        cfg.top = cfg.bottom + conf->size.y;
+    }
     cfg.decorateAsFloatingWindow = conf->is_decorated
         ? xplm_WindowDecorationRoundRectangle
         : xplm_WindowDecorationSelfDecoratedResizable;
     cfg.layer = xplm_WindowLayerFloatingWindows;
     cfg.refcon = window;
     
-    window->ref = XPLMCreateWindowEx(&cfg);
-    window->conf = *conf;
-    window->refcon = refcon;
-    
-    if(!strlen(window->conf.id)) {
-        lacf_strlcpy(window->conf.id, window->conf.name, sizeof(window->conf.id));
-        strreplace(window->conf.id, " \t/\\~!@#$%^&*()-+=", '_');
-    }
+    WIN_REF(window) = XPLMCreateWindowEx(&cfg);
     
     if(conf->is_aspect_cstr) {
-        win_resize_ctl_init(&window->resize_ctl, window->ref, conf->size.x, conf->size.y);
+        win_resize_ctl_init(&window->resize_ctl, WIN_REF(window), conf->size.x, conf->size.y);
     }
     
     XPLMSetWindowResizingLimits(
-        window->ref,
+        WIN_REF(window),
         conf->size.x * conf->min_scale,
         conf->size.y * conf->min_scale,
         conf->size.x * conf->max_scale,
         conf->size.y * conf->max_scale
     );
-    XPLMSetWindowTitle(window->ref, conf->name);
+    XPLMSetWindowTitle(WIN_REF(window), conf->name);
     if(dr_geti(&sys.dr_vr_enabled) == 1) {
-        XPLMSetWindowPositioningMode(window->ref, xplm_WindowVR, 0);
+        XPLMSetWindowPositioningMode(WIN_REF(window), xplm_WindowVR, 0);
     }
+    if(entry) restore_window(window, entry);
     
-    avl_add(&sys.windows, window);
     return window;
 }
 
 static void window_destroy_private(window_t *window) {
     ASSERT3P(window, !=, NULL);
+    layout_key_t key;
+    live_key(key, window->conf.id);
+    htbl_remove(&sys.live_ids, key, false);
     window_unbind_cmd(window);
-    XPLMDestroyWindow(window->ref);
-    lacf_free(window);
+    rec_forget(window);
+    offscreen_fini(&window->offscreen);
+    XPLMDestroyWindow(WIN_REF(window));
 }
 
 void window_destroy(window_t *window) {
     ASSERT3P(window, !=, NULL);
-    avl_remove(&sys.windows, window);
     window_destroy_private(window);
+    reg_release(window);
 }
 
 static int window_cmd_handler(XPLMCommandRef cmd, XPLMCommandPhase phase, void *userdata) {
@@ -596,7 +1222,7 @@ XPLMCommandRef window_bind_cmd(window_t *window, const char *cmd) {
 
 void window_pop_out(window_t *window) {
     ASSERT3P(window, !=, NULL);
-	XPLMSetWindowPositioningMode(window->ref, xplm_WindowPopOut, -1);
+	layout_set_mode(window, xplm_WindowPopOut, -1);
 }
 
 void window_toggle(window_t *window) {
@@ -611,38 +1237,38 @@ void window_toggle(window_t *window) {
 static void window_center_mouse(window_t *window, int w, int h) {
     int x, y;
     XPLMGetMouseLocationGlobal(&x, &y);
-    XPLMSetWindowGeometry(window->ref, x - w/2.0, y + h/2.0, x + w/2.0, y - h/2.0);
+    layout_set_geometry(window, false, x - w/2.0, y + h/2.0, x + w/2.0, y - h/2.0);
 }
 
 void window_show(window_t *window) {
     ASSERT3P(window, !=, NULL);
     
-    if(XPLMWindowIsPoppedOut(window->ref)) {
-        XPLMSetWindowPositioningMode(window->ref, xplm_WindowPositionFree, 0);
+    if(XPLMWindowIsPoppedOut(WIN_REF(window))) {
+        layout_set_mode(window, xplm_WindowPositionFree, 0);
     }
-    XPLMSetWindowIsVisible(window->ref, 1);
-    if(window->conf.key) XPLMTakeKeyboardFocus(window->ref);
+    layout_set_visible(window, true);
+    if(window->conf.key) XPLMTakeKeyboardFocus(WIN_REF(window));
     
     // Check that the window is within the visible area, move it if not!
     
-    if(XPLMWindowIsPoppedOut(window->ref)) return;
+    if(XPLMWindowIsPoppedOut(WIN_REF(window))) return;
     
     if(is_out_of_bounds(window)) {
         int left, top, right, bottom;
-        XPLMGetWindowGeometry(window->ref, &left, &top, &right, &bottom);
+        XPLMGetWindowGeometry(WIN_REF(window), &left, &top, &right, &bottom);
         window_center_mouse(window, right - left, top - bottom);
     }
 }
 
 void window_hide(window_t *window) {
     ASSERT3P(window, !=, NULL);
-    XPLMSetWindowIsVisible(window->ref, 0);
-    if(XPLMHasKeyboardFocus(window->ref)) XPLMTakeKeyboardFocus(NULL);
+    layout_set_visible(window, false);
+    if(XPLMHasKeyboardFocus(WIN_REF(window))) XPLMTakeKeyboardFocus(NULL);
 }
 
 bool window_is_visible(const window_t *window) {
     ASSERT3P(window, !=, NULL);
-    return XPLMGetWindowIsVisible(window->ref);
+    return XPLMGetWindowIsVisible(WIN_REF(window));
 }
 
 // We want to convert from X-plane's global coordinate system to a classic, -y window space
@@ -663,7 +1289,7 @@ vect2_t window_desk2win(const window_t *window, vect2_t pos) {
     ASSERT3P(window, !=, NULL);
     
     int left, top, right, bottom;
-    XPLMGetWindowGeometry(window->ref, &left, &top, &right, &bottom);
+    XPLMGetWindowGeometry(WIN_REF(window), &left, &top, &right, &bottom);
     UNUSED(right);
     UNUSED(bottom);
 
@@ -674,18 +1300,158 @@ vect2_t window_win2desk(const window_t *window, vect2_t pos) {
     ASSERT3P(window, !=, NULL);
     
     int left, top, right, bottom;
-    XPLMGetWindowGeometry(window->ref, &left, &top, &right, &bottom);
+    XPLMGetWindowGeometry(WIN_REF(window), &left, &top, &right, &bottom);
     UNUSED(right);
     UNUSED(bottom);
 
     return VECT2(pos.x+left, top-pos.y);
 }
 
+// All four batch conversions are the same per-axis affine transform, out = in * mul + add, which
+// maps directly onto a two-lane double vector.
+static void affine2_v(const vect2_t *in, vect2_t *out, size_t n, vect2_t mul, vect2_t add) {
+#if defined(__SSE2__)
+    __m128d m = _mm_set_pd(mul.y, mul.x);
+    __m128d a = _mm_set_pd(add.y, add.x);
+    for(size_t i = 0; i < n; ++i) {
+        __m128d v = _mm_loadu_pd(&in[i].x);
+        _mm_storeu_pd(&out[i].x, _mm_add_pd(_mm_mul_pd(v, m), a));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const double mv[2] = {mul.x, mul.y};
+    const double av[2] = {add.x, add.y};
+    float64x2_t m = vld1q_f64(mv);
+    float64x2_t a = vld1q_f64(av);
+    for(size_t i = 0; i < n; ++i) {
+        float64x2_t v = vld1q_f64(&in[i].x);
+        vst1q_f64(&out[i].x, vfmaq_f64(a, v, m));
+    }
+#else
+    for(size_t i = 0; i < n; ++i) {
+        out[i] = VECT2(in[i].x * mul.x + add.x, in[i].y * mul.y + add.y);
+    }
+#endif
+}
+
+void window_desk2win_v(const window_t *window, const vect2_t *in, vect2_t *out, size_t n) {
+    ASSERT3P(window, !=, NULL);
+    ASSERT(n == 0 || (in != NULL && out != NULL));
+    
+    int left, top, right, bottom;
+    XPLMGetWindowGeometry(WIN_REF(window), &left, &top, &right, &bottom);
+    affine2_v(in, out, n, VECT2(1, -1), VECT2(-left, top));
+}
+
+void window_win2desk_v(const window_t *window, const vect2_t *in, vect2_t *out, size_t n) {
+    ASSERT3P(window, !=, NULL);
+    ASSERT(n == 0 || (in != NULL && out != NULL));
+    
+    int left, top, right, bottom;
+    XPLMGetWindowGeometry(WIN_REF(window), &left, &top, &right, &bottom);
+    affine2_v(in, out, n, VECT2(1, -1), VECT2(left, top));
+}
+
+void window_desk2win_scaled_v(const window_t *window, const vect2_t *in, vect2_t *out, size_t n) {
+    ASSERT3P(window, !=, NULL);
+    ASSERT(n == 0 || (in != NULL && out != NULL));
+    
+    int left, top, right, bottom;
+    XPLMGetWindowGeometry(WIN_REF(window), &left, &top, &right, &bottom);
+    vect2_t scale = content_scale(window, left, top, right, bottom);
+    affine2_v(in, out, n, VECT2(1 / scale.x, -1 / scale.y), VECT2(-left / scale.x, top / scale.y));
+}
+
+void window_win2desk_scaled_v(const window_t *window, const vect2_t *in, vect2_t *out, size_t n) {
+    ASSERT3P(window, !=, NULL);
+    ASSERT(n == 0 || (in != NULL && out != NULL));
+    
+    int left, top, right, bottom;
+    XPLMGetWindowGeometry(WIN_REF(window), &left, &top, &right, &bottom);
+    vect2_t scale = content_scale(window, left, top, right, bottom);
+    affine2_v(in, out, n, VECT2(scale.x, -scale.y), VECT2(left, top));
+}
+
+void window_set_render(window_t *window, window_render_t render, double scale) {
+    ASSERT3P(window, !=, NULL);
+    window->conf.render = render;
+    window->conf.render_scale = scale;
+    if(render == WINDOW_RENDER_NATIVE && !sys.reg.sched[window->handle].period) {
+        offscreen_fini(&window->offscreen);
+    }
+}
+
+void window_sys_set_frame_budget(double ms) {
+    sys.frame_budget = ms;
+}
+
+void window_set_refresh(window_t *window, double hz, int priority) {
+    ASSERT3P(window, !=, NULL);
+    sched_t *sched = &sys.reg.sched[window->handle];
+    
+    sched->period = hz > 0 ? 1e6 / hz : 0;
+    sched->priority = priority;
+    sched->starved = 0;
+    if(!sched->period && window->conf.render == WINDOW_RENDER_NATIVE) {
+        offscreen_fini(&window->offscreen);
+    }
+}
+
+void window_get_sched_stats(const window_t *window, window_sched_stats_t *stats) {
+    ASSERT3P(window, !=, NULL);
+    ASSERT3P(stats, !=, NULL);
+    const sched_t *sched = &sys.reg.sched[window->handle];
+    
+    stats->draw_time = sched->draw_time;
+    stats->starved = sched->starved;
+    stats->starved_max = sched->starved_max;
+    stats->skipped = sched->skipped;
+    stats->drawn = sched->drawn;
+}
+
+void window_gl_mem_add(window_gl_mem_t *mem, const window_gl_mem_t *other) {
+    ASSERT3P(mem, !=, NULL);
+    ASSERT3P(other, !=, NULL);
+    
+    mem->textures += other->textures;
+    mem->framebuffers += other->framebuffers;
+    mem->programs += other->programs;
+    mem->caches += other->caches;
+    mem->texture_bytes += other->texture_bytes;
+    mem->cache_bytes += other->cache_bytes;
+}
+
+void window_sys_get_pvm(float pvm[16]) {
+    ASSERT3P(pvm, !=, NULL);
+    
+    mat4 m;
+    quad_pvm(m);
+    memcpy(pvm, m, sizeof(m));
+}
+
+void window_sys_get_gl_mem(window_gl_mem_t *mem) {
+    ASSERT3P(mem, !=, NULL);
+    
+    memset(mem, 0, sizeof(*mem));
+    quad_get_gl_mem(mem);
+    
+    window_gl_mem_t images;
+    window_image_get_gl_mem(&images);
+    window_gl_mem_add(mem, &images);
+}
+
+void window_get_gl_mem(const window_t *window, window_gl_mem_t *mem) {
+    ASSERT3P(window, !=, NULL);
+    ASSERT3P(mem, !=, NULL);
+    
+    memset(mem, 0, sizeof(*mem));
+    offscreen_get_gl_mem(&window->offscreen, mem);
+}
+
 vect2_t window_get_size(const window_t *window) {
     ASSERT3P(window, !=, NULL);
     
     int left, top, right, bottom;
-    XPLMGetWindowGeometry(window->ref, &left, &top, &right, &bottom);
+    XPLMGetWindowGeometry(WIN_REF(window), &left, &top, &right, &bottom);
     
     return VECT2(right - left, top - bottom);
 }
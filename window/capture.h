@@ -9,6 +9,7 @@
 */
 #ifndef _CAPTURE_H_
 #define _CAPTURE_H_
+#include <acfutils/glew.h>
 #include <window/window.h>
 
 #ifdef __cplusplus
@@ -17,12 +18,60 @@ extern "C" {
 
 typedef struct panel_cap_t panel_cap_t;
 
+typedef enum {
+    PANEL_CAP_FORMAT_AUTO,          // Same layout as the sim's framebuffer, for the fastest blit
+    PANEL_CAP_FORMAT_RGBA8,
+    PANEL_CAP_FORMAT_RGB565,        // Half the memory of RGBA8, with visible banding on gradients
+    PANEL_CAP_FORMAT_RGB10_A2,      // Keeps HDR-ish precision at the cost of RGBA8
+} panel_cap_format_t;
+
+typedef struct {
+    vect2_t             size;
+    panel_cap_format_t  format;
+    unsigned            num_buffers;    // See panel_cap_set_buffers(), 0 is the same as 1
+} panel_cap_conf_t;
+
 panel_cap_t *panel_cap_new(vect2_t size);
+panel_cap_t *panel_cap_new2(const panel_cap_conf_t *conf);
 void panel_cap_destroy(panel_cap_t *cap);
 
+// Adds a client framebuffer as an extra capture source, and returns the texture layer it is
+// captured into. Layer 0 is always the sim's current FBO. Every source is read from its lower-left
+// corner at the panel's size, and adding one recreates the panel's GL resources.
+unsigned panel_cap_add_source(panel_cap_t *cap, GLuint fbo);
+
 window_t *panel_cap_add_window(panel_cap_t *cap, const char *name, const char *id, vect2_t pos, vect2_t size);
+window_t *panel_cap_add_window2(panel_cap_t *cap, const char *name, const char *id, vect2_t pos, vect2_t size,
+                                unsigned layer);
 void panel_cap_update(panel_cap_t *cap);
 
+// Number of capture textures to rotate through (1 to 4, default 1). With more than one, windows
+// draw from the newest texture the GPU had finished blitting into when the panel was last
+// updated, which may be a frame or two old, instead of waiting on the current blit.
+void panel_cap_set_buffers(panel_cap_t *cap, unsigned count);
+
+// When none of a panel's windows has been visible for `seconds`, its textures, framebuffers and
+// programs are freed, and capture stops until a window is shown again. Resources are
+// then recreated on the fly, which leaves the window blank for a frame. 0 disables eviction.
+void panel_cap_set_idle_evict(panel_cap_t *cap, double seconds);
+
+// Change detection hashes every texel of each window's region after every capture, on an 8x8 grid
+// of tiles, and reads the hashes back asynchronously. Channels are compared at 16 bits, so only
+// changes finer than that can go unnoticed.
+void panel_cap_set_change_detect(panel_cap_t *cap, bool enabled);
+
+// Whether any tile of the window's region changed since `*seen`, as far as the signatures read
+// back so far can tell (usually a frame or two behind the capture). Each consumer keeps its own
+// `seen`, starting at 0, which the call brings up to date; consumers don't hide changes from
+// each other. `mask`, if not NULL, gets one bit per tile, bit (y * 8 + x) with row 0 at the
+// bottom. Turning detection on, or adding the window, counts as a change to every tile.
+bool panel_cap_window_changed(const panel_cap_t *cap, const window_t *window, uint64_t *seen,
+                              uint64_t *mask);
+
+// GL resources held by the whole panel, including its windows, or by one of its windows.
+void panel_cap_get_gl_mem(const panel_cap_t *cap, window_gl_mem_t *mem);
+void panel_cap_get_window_gl_mem(const panel_cap_t *cap, const window_t *window, window_gl_mem_t *mem);
+
 #ifdef __cplusplus
 }
 #endif
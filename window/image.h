@@ -0,0 +1,38 @@
+/*===--------------------------------------------------------------------------------------------===
+ * image.h
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2024 Amy Parent
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+#ifndef _IMAGE_H_
+#define _IMAGE_H_
+#include <window/window.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Shared image cache. Images are keyed by path and reference-counted, so every caller asking for
+// the same file shares one decoded copy and one texture. PNG decoding happens on worker threads;
+// the texture is uploaded by the first draw after decoding is done, and draws before that are
+// no-ops. Must be used between window_sys_init() and window_sys_fini(), from the sim thread.
+
+typedef struct window_image_t window_image_t;
+
+window_image_t *window_image_get(const char *path);
+void window_image_release(window_image_t *image);
+
+bool window_image_is_ready(const window_image_t *image);
+void window_image_draw(window_image_t *image, vect2_t pos, vect2_t size, double alpha);
+
+// Textures held by the image cache. window_sys_get_gl_mem() already includes them.
+void window_image_get_gl_mem(window_gl_mem_t *mem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef _IMAGE_H_ */
@@ -0,0 +1,80 @@
+/*===--------------------------------------------------------------------------------------------===
+ * record.h
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2024 Amy Parent
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+#ifndef _RECORD_H_
+#define _RECORD_H_
+#include <window/window.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Input recording & replay. While a recording is active, every mouse, cursor and key event that
+// XPLM delivers to a libwindow window is logged, along with the routing decision libwindow made
+// for it: the branch taken and the value returned to the sim. A replay feeds the log back through
+// the same routing code, against whatever windows currently exist with matching ids, and counts
+// the events where either differs.
+
+bool window_rec_start(const char *path);
+void window_rec_stop(void);
+bool window_rec_is_active(void);
+
+typedef enum {
+    WINDOW_REC_CLICK,
+    WINDOW_REC_CURSOR,
+    WINDOW_REC_KEY,
+} window_rec_type_t;
+
+// Branch an event took through libwindow's routing.
+typedef enum {
+    WINDOW_ROUTE_NONE,              // Nothing handled it
+    WINDOW_ROUTE_BEHIND,            // Cursor over a window that isn't in front
+    WINDOW_ROUTE_FOCUS_LOST,        // Key event telling the window it lost keyboard focus
+    WINDOW_ROUTE_CLOSE,             // Close button clicked, or hovered by the cursor
+    WINDOW_ROUTE_POPOUT,            // Pop-out button clicked, or hovered by the cursor
+    WINDOW_ROUTE_DRAG_START,        // Mouse down that starts dragging the window
+    WINDOW_ROUTE_DRAG,
+    WINDOW_ROUTE_DRAG_END,
+    WINDOW_ROUTE_CALLBACK,          // Consumed by the window's callback
+    WINDOW_ROUTE_CALLBACK_PASSED,   // Passed to the window's callback, which didn't consume it
+} window_route_t;
+
+typedef struct {
+    window_rec_type_t   type;
+    const char          *window_id;
+    uint64_t            time;       // Microseconds since the start of the recording
+    double              latency;    // Microseconds spent routing the event during replay
+    int                 expected;
+    int                 result;
+    window_route_t      expected_route;
+    window_route_t      route;
+} window_replay_event_t;
+
+typedef void (*window_replay_f)(const window_replay_event_t *event, void *refcon);
+
+typedef struct {
+    unsigned            events;
+    unsigned            mismatches; // Events with a different result or route than recorded
+    unsigned            skipped;    // Events for windows that don't exist in this session
+    double              latency_avg;
+    double              latency_max;
+} window_replay_stats_t;
+
+// Replays the log at `path`. When `realtime` is set, events are spaced out the way they were
+// recorded, otherwise they are dispatched back to back. `cb` is optional and is called once for
+// every event replayed.
+bool window_replay(const char *path, bool realtime, window_replay_f cb, void *refcon,
+                   window_replay_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef _RECORD_H_ */
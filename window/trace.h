@@ -0,0 +1,41 @@
+/*===--------------------------------------------------------------------------------------------===
+ * trace.h
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2024 Amy Parent
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+#ifndef _TRACE_H_
+#define _TRACE_H_
+#include <window/window.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Timeline tracing. While a trace is running, libwindow records begin/end events for window
+// draws, user callbacks, panel captures, layout save/restore and input dispatch, on whichever
+// thread they happen. Events go to a per-thread buffer, and are written to `libwindow-trace.json`
+// in the output directory given to window_sys_init(), in the Chrome trace event format (open it
+// in Perfetto or chrome://tracing). Events that don't fit in a thread's buffer between two
+// flushes are dropped.
+
+// Starts a trace, replacing any previous trace file. With `flush_interval` > 0, buffered events
+// are written out every `flush_interval` seconds; otherwise only by window_trace_flush() and
+// window_trace_stop().
+bool window_trace_start(double flush_interval);
+void window_trace_stop(void);
+bool window_trace_flush(void);
+bool window_trace_is_active(void);
+
+// Client events, shown on the same timeline. `name` must be a string literal.
+void window_trace_begin(const char *name);
+void window_trace_end(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef _TRACE_H_ */
@@ -14,6 +14,7 @@
 #include <XPLMUtilities.h>
 #include <acfutils/geom.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -31,6 +32,20 @@ typedef void (*window_draw_f)(window_t *window, vect2_t pos, vect2_t size, void
 typedef int (*window_click_f)(window_t *window, mouse_action_t act, vect2_t pos, vect2_t scale, void *refcon);
 typedef void (*window_key_f)(window_t *window, int key, char c, bool ctrl, void *refcon);
 
+// How a window's content is rendered. With anything but WINDOW_RENDER_NATIVE, once the window is
+// scaled past a cap (a multiple of its base size), the draw callback renders into an offscreen
+// target at the capped resolution, which is then upscaled into the window. The callback is then
+// called with pos = (0, 0) and size = the target's size, with the GL fixed-function matrices set
+// up for that space. Callbacks that draw with shaders should get their matrix from
+// window_sys_get_pvm() rather than from the sim's matrix datarefs, which don't know about it.
+typedef enum {
+    WINDOW_RENDER_NATIVE,       // Always draw at on-screen size
+    WINDOW_RENDER_QUALITY,      // Capped at 2x base size
+    WINDOW_RENDER_BALANCED,     // Capped at base size
+    WINDOW_RENDER_PERFORMANCE,  // Capped at half base size
+    WINDOW_RENDER_CUSTOM,       // Capped at `render_scale` x base size
+} window_render_t;
+
 typedef struct {
     vect2_t         size;
     double          min_scale;
@@ -43,16 +58,70 @@ typedef struct {
     window_draw_f   draw;
     window_click_f  click;
     window_key_f    key;
+    
+    window_render_t render;
+    double          render_scale;
 } window_conf_t;
 
 void window_sys_init(const char *assets_dir, const char *output_dir);
 void window_sys_save(void);
+// windows.txt is kept in memory once read, and only read again when it changes on disk. Windows
+// created after that open where they were saved, without needing another restore.
 void window_sys_restore(void);
 void window_sys_fini(void);
 
 void window_sys_move_to_vr(void);
 void window_sys_move_to_2d(void);
 
+// Layout transactions. Between begin and commit, position mode, geometry and visibility changes
+// are collected instead of being sent to the sim; only the last change to each is kept, and the
+// result is applied once at the start of the next frame. Transactions nest, and
+// window_sys_restore/move_to_vr/move_to_2d always run inside one. Getters keep returning the
+// current state until the changes are applied.
+void window_layout_begin(void);
+void window_layout_commit(void);
+
+// Redraw scheduling. A window given a refresh rate only has its draw callback called when it's
+// due, and only while the frame's redraw budget (in milliseconds, 0 for unlimited) allows;
+// otherwise the last image it rendered is shown. Due windows are served by priority, highest
+// first, with windows that keep getting skipped moving up the queue. Windows without a refresh
+// rate are drawn every frame and aren't counted against the budget.
+typedef struct {
+    double              draw_time;      // Moving average of the draw callback's time, in ms
+    unsigned            starved;        // Consecutive frames the window was due but skipped
+    unsigned            starved_max;
+    unsigned long long  skipped;
+    unsigned long long  drawn;
+} window_sched_stats_t;
+
+void window_sys_set_frame_budget(double ms);
+
+// GL resources owned by libwindow. Byte counts are estimates: textures are counted at their
+// nominal size, and vertex caches at their capacity.
+typedef struct {
+    unsigned            textures;
+    unsigned            framebuffers;
+    unsigned            programs;
+    unsigned            caches;
+    size_t              texture_bytes;
+    size_t              cache_bytes;
+} window_gl_mem_t;
+
+void window_gl_mem_add(window_gl_mem_t *mem, const window_gl_mem_t *other);
+// Resources shared by every window: the quad program and vertex cache, and the image cache,
+// which holds the decoration icons as well as the images loaded with window_image_get().
+void window_sys_get_gl_mem(window_gl_mem_t *mem);
+
+// Number of GL binding calls libwindow made, and skipped because they would not have changed
+// anything, since start-up or the last reset.
+typedef struct {
+    unsigned long long  issued;
+    unsigned long long  skipped;
+} window_gl_stats_t;
+
+void window_sys_get_gl_stats(window_gl_stats_t *stats);
+void window_sys_reset_gl_stats(void);
+
 window_t *window_new(const window_conf_t *conf, void *refcon);
 void window_destroy(window_t *window);
 
@@ -69,11 +138,26 @@ bool window_is_visible(const window_t *window);
 bool window_is_popped_out(const window_t *window);
 
 vect2_t window_get_size(const window_t *window);
+// Projection * modelview for the space a draw callback was given coordinates in: the sim's view
+// when drawing on screen, or the offscreen target's when drawing into one. Column-major.
+void window_sys_get_pvm(float pvm[16]);
+void window_set_render(window_t *window, window_render_t render, double scale);
+void window_set_refresh(window_t *window, double hz, int priority);
+void window_get_sched_stats(const window_t *window, window_sched_stats_t *stats);
+void window_get_gl_mem(const window_t *window, window_gl_mem_t *mem);
 
 
 vect2_t window_desk2win(const window_t *window, vect2_t pos);
 vect2_t window_win2desk(const window_t *window, vect2_t pos);
 
+// Batch versions of the above, which read the window's geometry once for the whole array. `in`
+// and `out` may be the same array. The _scaled variants convert to and from the window's content
+// space, i.e. divided by the scale passed to click callbacks.
+void window_desk2win_v(const window_t *window, const vect2_t *in, vect2_t *out, size_t n);
+void window_win2desk_v(const window_t *window, const vect2_t *in, vect2_t *out, size_t n);
+void window_desk2win_scaled_v(const window_t *window, const vect2_t *in, vect2_t *out, size_t n);
+void window_win2desk_scaled_v(const window_t *window, const vect2_t *in, vect2_t *out, size_t n);
+
 #ifdef __cplusplus
 }
 #endif
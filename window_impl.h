@@ -0,0 +1,78 @@
+/*===--------------------------------------------------------------------------------------------===
+ * window_impl.h
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2024 Amy Parent
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+#ifndef _WINDOW_IMPL_H_
+#define _WINDOW_IMPL_H_
+
+#include <acfutils/dr.h>
+#include <acfutils/glew.h>
+#include <acfutils/glutils.h>
+#include <acfutils/widget.h>
+#include <window/record.h>
+#include <window/window.h>
+#include <stdint.h>
+#include "glstate_impl.h"
+#include "quad_impl.h"
+#include "trace_impl.h"
+
+typedef uint32_t window_handle_t;
+
+// Offscreen render target used to draw a window's content at a different resolution than its
+// on-screen size, then composite it into the window. The target holds premultiplied alpha.
+typedef struct {
+    GLuint          fbo;
+    GLuint          tex;
+    vect2_t         size;
+    
+    GLint           prev_fbo;
+    GLint           prev_viewport[4];
+} offscreen_t;
+
+bool offscreen_begin(offscreen_t *off, vect2_t size);
+void offscreen_end(offscreen_t *off);
+void offscreen_draw(offscreen_t *off, vect2_t pos, vect2_t size);
+void offscreen_fini(offscreen_t *off);
+void offscreen_get_gl_mem(const offscreen_t *off, window_gl_mem_t *mem);
+
+// Cold per-window state. The state touched every frame (XPLM window ref, hover and drag tracking)
+// lives in the registry's packed arrays in window.c, indexed by `handle`.
+struct window_t {
+    window_handle_t     handle;
+    XPLMCommandRef      cmd;
+    
+    bool                is_decorated;
+    win_resize_ctl_t    resize_ctl;
+    offscreen_t         offscreen;
+    
+    window_conf_t       conf;
+    void                *refcon;
+};
+
+// Event routing, shared by the XPLM callbacks and the input replayer. These return the same
+// values the XPLM callbacks hand back to the sim, and report the branch taken in `route`. The
+// recorder logs both.
+int window_route_click(window_t *window, int x, int y, XPLMMouseStatus status, window_route_t *route);
+XPLMCursorStatus window_route_cursor(window_t *window, int x, int y, window_route_t *route);
+int window_route_key(window_t *window, char key, XPLMKeyFlags flags, char vkey, int lose,
+                     window_route_t *route);
+
+window_t *window_find(const char *id);
+
+// Input recorder hooks, no-ops unless a recording is in progress.
+void rec_click(const window_t *window, int x, int y, XPLMMouseStatus status, int result, window_route_t route);
+void rec_cursor(const window_t *window, int x, int y, XPLMCursorStatus result, window_route_t route);
+void rec_key(const window_t *window, char key, XPLMKeyFlags flags, char vkey, int lose, int result,
+             window_route_t route);
+void rec_forget(const window_t *window);
+void rec_fini(void);
+
+void image_sys_init(void);
+void image_sys_fini(void);
+
+#endif /* ifndef _WINDOW_IMPL_H_ */